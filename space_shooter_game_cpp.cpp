@@ -1,4 +1,6 @@
 #include <SFML/Graphics.hpp>
+#include <SFML/Network.hpp>
+#include <SFML/OpenGL.hpp>
 #include <iostream>
 #include <vector>
 #include <string>
@@ -7,6 +9,45 @@
 #include <ctime>
 #include <sstream>
 #include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <cstdio>
+#include <climits>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <csignal>
+#include <coroutine>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SPACE_SHOOTER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SPACE_SHOOTER_TARGET_SSE
+#define SPACE_SHOOTER_TARGET_AVX2
+#else
+#define SPACE_SHOOTER_TARGET_SSE __attribute__((target("sse2")))
+#define SPACE_SHOOTER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#ifdef _MSC_VER
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#define SPACE_SHOOTER_NOINLINE __declspec(noinline)
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#define SPACE_SHOOTER_NOINLINE __attribute__((noinline))
+#endif
 
 using namespace sf;
 using namespace std;
@@ -14,6 +55,226 @@ using namespace std;
 const int WINDOW_WIDTH = 1200;
 const int WINDOW_HEIGHT = 800;
 const float PI = 3.14159265f;
+const float SCROLL_SPEED = 40.f;
+const int CHUNK_HEIGHT = WINDOW_HEIGHT / 2;
+const int LEVEL_SCREENS = 100;
+const int LEVEL_HEIGHT = WINDOW_HEIGHT * LEVEL_SCREENS;
+const int LEVEL_CHUNKS = LEVEL_HEIGHT / CHUNK_HEIGHT;
+const float BASE_SHOOT_COOLDOWN = 0.2f;
+const float RAPID_FIRE_COOLDOWN = 0.08f;
+const float SPREAD_SHOT_SPEED = 220.f;
+const float SLOW_MOTION_SCALE = 0.4f;
+
+enum AllocationPhase {
+    PHASE_OTHER,
+    PHASE_INPUT,
+    PHASE_UPDATE,
+    PHASE_RENDER,
+    PHASE_PRESENT,
+    PHASE_INSTRUMENTATION,
+    PHASE_COUNT
+};
+
+struct AllocationCounters {
+    uint64_t allocations[PHASE_COUNT];
+    uint64_t bytes[PHASE_COUNT];
+
+    uint64_t totalAllocations(bool includeInstrumentation = true) const {
+        uint64_t total = 0;
+        for (int i = 0; i < PHASE_COUNT; ++i) {
+            if (includeInstrumentation || i != PHASE_INSTRUMENTATION) total += allocations[i];
+        }
+        return total;
+    }
+
+    uint64_t totalBytes(bool includeInstrumentation = true) const {
+        uint64_t total = 0;
+        for (int i = 0; i < PHASE_COUNT; ++i) {
+            if (includeInstrumentation || i != PHASE_INSTRUMENTATION) total += bytes[i];
+        }
+        return total;
+    }
+
+    AllocationCounters operator-(const AllocationCounters& other) const {
+        AllocationCounters result;
+        for (int i = 0; i < PHASE_COUNT; ++i) {
+            result.allocations[i] = allocations[i] - other.allocations[i];
+            result.bytes[i] = bytes[i] - other.bytes[i];
+        }
+        return result;
+    }
+};
+
+class AllocationTracker {
+private:
+    static atomic<uint64_t> allocations[PHASE_COUNT];
+    static atomic<uint64_t> bytes[PHASE_COUNT];
+    static thread_local AllocationPhase currentPhase;
+
+public:
+    static void record(size_t size) {
+        allocations[currentPhase].fetch_add(1, memory_order_relaxed);
+        bytes[currentPhase].fetch_add(size, memory_order_relaxed);
+    }
+
+    static void setPhase(AllocationPhase phase) {
+        currentPhase = phase;
+    }
+
+    static AllocationPhase getPhase() {
+        return currentPhase;
+    }
+
+    static AllocationCounters snapshot() {
+        AllocationCounters counters;
+        for (int i = 0; i < PHASE_COUNT; ++i) {
+            counters.allocations[i] = allocations[i].load(memory_order_relaxed);
+            counters.bytes[i] = bytes[i].load(memory_order_relaxed);
+        }
+        return counters;
+    }
+
+    static const char* phaseName(int phase) {
+        static const char* names[PHASE_COUNT] = { "other", "input", "update", "render", "present", "instrumentation" };
+        return names[phase];
+    }
+};
+
+atomic<uint64_t> AllocationTracker::allocations[PHASE_COUNT];
+atomic<uint64_t> AllocationTracker::bytes[PHASE_COUNT];
+thread_local AllocationPhase AllocationTracker::currentPhase = PHASE_OTHER;
+
+class AllocationPhaseScope {
+private:
+    AllocationPhase previous;
+
+public:
+    explicit AllocationPhaseScope(AllocationPhase phase) : previous(AllocationTracker::getPhase()) {
+        AllocationTracker::setPhase(phase);
+    }
+
+    ~AllocationPhaseScope() {
+        AllocationTracker::setPhase(previous);
+    }
+};
+
+#ifndef SPACE_SHOOTER_NO_ALLOCATION_TRACKING
+SPACE_SHOOTER_NOINLINE static void* trackedAllocate(size_t size) noexcept {
+    AllocationTracker::record(size);
+    return malloc(size ? size : 1);
+}
+
+SPACE_SHOOTER_NOINLINE static void* trackedAllocate(size_t size, align_val_t alignment) noexcept {
+    size_t align = max(static_cast<size_t>(alignment), sizeof(void*));
+    size_t rounded = ((size ? size : 1) + align - 1) / align * align;
+    AllocationTracker::record(size);
+#ifdef _MSC_VER
+    return _aligned_malloc(rounded, align);
+#else
+    return aligned_alloc(align, rounded);
+#endif
+}
+
+SPACE_SHOOTER_NOINLINE static void trackedFree(void* memory) noexcept {
+    free(memory);
+}
+
+SPACE_SHOOTER_NOINLINE static void trackedFree(void* memory, align_val_t) noexcept {
+#ifdef _MSC_VER
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+void* operator new(size_t size) {
+    void* memory = trackedAllocate(size);
+    if (!memory) throw bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size) {
+    void* memory = trackedAllocate(size);
+    if (!memory) throw bad_alloc();
+    return memory;
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept {
+    return trackedAllocate(size);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept {
+    return trackedAllocate(size);
+}
+
+void* operator new(size_t size, align_val_t alignment) {
+    void* memory = trackedAllocate(size, alignment);
+    if (!memory) throw bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size, align_val_t alignment) {
+    void* memory = trackedAllocate(size, alignment);
+    if (!memory) throw bad_alloc();
+    return memory;
+}
+
+void* operator new(size_t size, align_val_t alignment, const nothrow_t&) noexcept {
+    return trackedAllocate(size, alignment);
+}
+
+void* operator new[](size_t size, align_val_t alignment, const nothrow_t&) noexcept {
+    return trackedAllocate(size, alignment);
+}
+
+void operator delete(void* memory) noexcept {
+    trackedFree(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    trackedFree(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    trackedFree(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+    trackedFree(memory);
+}
+
+void operator delete(void* memory, const nothrow_t&) noexcept {
+    trackedFree(memory);
+}
+
+void operator delete[](void* memory, const nothrow_t&) noexcept {
+    trackedFree(memory);
+}
+
+void operator delete(void* memory, align_val_t alignment) noexcept {
+    trackedFree(memory, alignment);
+}
+
+void operator delete[](void* memory, align_val_t alignment) noexcept {
+    trackedFree(memory, alignment);
+}
+
+void operator delete(void* memory, size_t, align_val_t alignment) noexcept {
+    trackedFree(memory, alignment);
+}
+
+void operator delete[](void* memory, size_t, align_val_t alignment) noexcept {
+    trackedFree(memory, alignment);
+}
+
+void operator delete(void* memory, align_val_t alignment, const nothrow_t&) noexcept {
+    trackedFree(memory, alignment);
+}
+
+void operator delete[](void* memory, align_val_t alignment, const nothrow_t&) noexcept {
+    trackedFree(memory, alignment);
+}
+#endif
 
 enum GameState {
     MENU,
@@ -27,7 +288,579 @@ struct Velocity {
     Velocity(float x = 0, float y = 0) : x(x), y(y) {}
 };
 
-class ParticleSystem : public Drawable {
+struct PlayerInput {
+    float moveX, moveY;
+    bool fire;
+    PlayerInput(float moveX = 0, float moveY = 0, bool fire = false)
+        : moveX(moveX), moveY(moveY), fire(fire) {}
+};
+
+enum EntityKind {
+    ENTITY_PLAYER = 1,
+    ENTITY_ENEMY,
+    ENTITY_PLAYER_BULLET,
+    ENTITY_ENEMY_BULLET,
+    ENTITY_POWER_UP,
+    ENTITY_MISSILE
+};
+
+inline uint64_t hashMix(uint64_t value) {
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+inline uint64_t hashCombine(uint64_t seed, uint64_t value) {
+    return hashMix(seed ^ value);
+}
+
+inline uint64_t packFloats(float high, float low) {
+    uint32_t highBits, lowBits;
+    memcpy(&highBits, &high, sizeof(highBits));
+    memcpy(&lowBits, &low, sizeof(lowBits));
+    return (static_cast<uint64_t>(highBits) << 32) | lowBits;
+}
+
+inline uint64_t packInts(int high, int low) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(high)) << 32) | static_cast<uint32_t>(low);
+}
+
+inline uint64_t entityStateHash(EntityKind kind, uint32_t id, uint64_t a, uint64_t b = 0, uint64_t c = 0) {
+    uint64_t key = (static_cast<uint64_t>(kind) << 32) | id;
+    return hashMix(key * 0x9E3779B97F4A7C15ull ^ a * 0xC2B2AE3D27D4EB4Full ^
+        b * 0x165667B19E3779F9ull ^ c * 0xD6E8FEB86659FD93ull);
+}
+
+struct Bullet {
+    Vector2f position;
+    Vector2f velocity;
+    float radius;
+    uint32_t id;
+    uint64_t hashValue;
+
+    Bullet(Vector2f position = Vector2f(0, 0), Vector2f velocity = Vector2f(0, 0), float radius = 0)
+        : position(position), velocity(velocity), radius(radius), id(0), hashValue(0) {}
+
+    uint64_t computeHash(EntityKind kind) const {
+        return entityStateHash(kind, id, packFloats(position.x, position.y), packFloats(velocity.x, velocity.y));
+    }
+
+    uint64_t rehash(EntityKind kind) {
+        uint64_t previous = hashValue;
+        hashValue = computeHash(kind);
+        return previous ^ hashValue;
+    }
+
+    uint64_t getHash() const { return hashValue; }
+
+    FloatRect getBounds() const {
+        return FloatRect(position.x - radius, position.y - radius, radius * 2, radius * 2);
+    }
+};
+
+class Random {
+private:
+    uint32_t state;
+
+public:
+    explicit Random(uint32_t seed = 1) {
+        setSeed(seed);
+    }
+
+    void setSeed(uint32_t seed) {
+        state = seed ? seed : 0x9E3779B9u;
+    }
+
+    uint32_t getState() const {
+        return state;
+    }
+
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    int nextInt(int bound) {
+        return static_cast<int>(next() % static_cast<uint32_t>(bound));
+    }
+};
+
+class WorkerPool {
+private:
+    typedef void (*JobFunction)(void* context, size_t begin, size_t end);
+
+    vector<thread> workers;
+    mutex jobMutex;
+    condition_variable jobReady;
+    condition_variable jobDone;
+    JobFunction jobFunction;
+    void* jobContext;
+    size_t jobCount;
+    unsigned generation;
+    unsigned pendingWorkers;
+    bool stopping;
+
+    void workerLoop(unsigned workerIndex) {
+        unsigned seenGeneration = 0;
+        while (true) {
+            unique_lock<mutex> lock(jobMutex);
+            jobReady.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping) return;
+            seenGeneration = generation;
+            lock.unlock();
+
+            runSlice(workerIndex + 1);
+
+            lock.lock();
+            if (--pendingWorkers == 0) {
+                jobDone.notify_one();
+            }
+        }
+    }
+
+    void runSlice(unsigned slice) {
+        size_t sliceCount = workers.size() + 1;
+        size_t begin = jobCount * slice / sliceCount;
+        size_t end = jobCount * (slice + 1) / sliceCount;
+        if (begin < end) {
+            jobFunction(jobContext, begin, end);
+        }
+    }
+
+    void run(size_t count, void* context, JobFunction function) {
+        if (workers.empty() || count < 2) {
+            function(context, 0, count);
+            return;
+        }
+
+        {
+            lock_guard<mutex> lock(jobMutex);
+            jobFunction = function;
+            jobContext = context;
+            jobCount = count;
+            pendingWorkers = static_cast<unsigned>(workers.size());
+            generation++;
+        }
+        jobReady.notify_all();
+
+        runSlice(0);
+
+        unique_lock<mutex> lock(jobMutex);
+        jobDone.wait(lock, [&] { return pendingWorkers == 0; });
+    }
+
+public:
+    explicit WorkerPool(unsigned threadCount) : jobFunction(nullptr), jobContext(nullptr),
+        jobCount(0), generation(0), pendingWorkers(0), stopping(false) {
+        for (unsigned i = 1; i < max(threadCount, 1u); ++i) {
+            workers.emplace_back(&WorkerPool::workerLoop, this, i - 1);
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            lock_guard<mutex> lock(jobMutex);
+            stopping = true;
+        }
+        jobReady.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    unsigned getThreadCount() const {
+        return static_cast<unsigned>(workers.size()) + 1;
+    }
+
+    template <typename Job>
+    void parallelFor(size_t count, Job& job) {
+        run(count, &job, [](void* context, size_t begin, size_t end) {
+            (*static_cast<Job*>(context))(begin, end);
+        });
+    }
+};
+
+class SpatialGrid {
+private:
+    static const int BASE_CELL_SIZE = 64;
+    static const int MIN_CELL_SIZE = 16;
+    static const int ITEMS_PER_CELL = 2;
+    static const int MAX_CELLS = 4096;
+    static constexpr size_t MAX_K = 16;
+
+    float cellSize;
+    float originX, originY;
+    int columns, rows;
+    vector<uint32_t> cellStart;
+    vector<uint32_t> cellCursor;
+    vector<uint32_t> items;
+    vector<uint32_t> itemCell;
+    vector<Vector2f> points;
+
+    int columnOf(float x) const {
+        return max(0, min(columns - 1, static_cast<int>((x - originX) / cellSize)));
+    }
+
+    int rowOf(float y) const {
+        return max(0, min(rows - 1, static_cast<int>((y - originY) / cellSize)));
+    }
+
+    template <typename Visitor>
+    void visitCells(int firstColumn, int lastColumn, int row, Visitor& visit) const {
+        if (row < 0 || row >= rows) return;
+        firstColumn = max(firstColumn, 0);
+        lastColumn = min(lastColumn, columns - 1);
+        for (int column = firstColumn; column <= lastColumn; ++column) {
+            int cell = row * columns + column;
+            for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; ++i) {
+                visit(items[i]);
+            }
+        }
+    }
+
+    template <typename Visitor>
+    void visitRing(int centerColumn, int centerRow, int ring, Visitor& visit) const {
+        if (ring == 0) {
+            visitCells(centerColumn, centerColumn, centerRow, visit);
+            return;
+        }
+        visitCells(centerColumn - ring, centerColumn + ring, centerRow - ring, visit);
+        visitCells(centerColumn - ring, centerColumn + ring, centerRow + ring, visit);
+        for (int row = centerRow - ring + 1; row < centerRow + ring; ++row) {
+            visitCells(centerColumn - ring, centerColumn - ring, row, visit);
+            visitCells(centerColumn + ring, centerColumn + ring, row, visit);
+        }
+    }
+
+public:
+    SpatialGrid() : cellSize(BASE_CELL_SIZE), originX(0), originY(0), columns(1), rows(1), cellStart(2, 0) {}
+
+    void reserve(size_t capacity) {
+        cellStart.reserve(MAX_CELLS + 1);
+        cellCursor.reserve(MAX_CELLS);
+        items.reserve(capacity);
+        itemCell.reserve(capacity);
+        points.reserve(capacity);
+    }
+
+    template <typename PositionOf>
+    void rebuild(size_t count, PositionOf positionOf) {
+        points.resize(count);
+        itemCell.resize(count);
+        items.resize(count);
+
+        float minX = 0, minY = 0, maxX = 0, maxY = 0;
+        for (size_t i = 0; i < count; ++i) {
+            points[i] = positionOf(i);
+            if (i == 0 || points[i].x < minX) minX = points[i].x;
+            if (i == 0 || points[i].y < minY) minY = points[i].y;
+            if (i == 0 || points[i].x > maxX) maxX = points[i].x;
+            if (i == 0 || points[i].y > maxY) maxY = points[i].y;
+        }
+
+        originX = minX;
+        originY = minY;
+        float area = max(1.0f, (maxX - minX) * (maxY - minY));
+        cellSize = max(static_cast<float>(MIN_CELL_SIZE), min(static_cast<float>(BASE_CELL_SIZE),
+            sqrt(area * ITEMS_PER_CELL / max<size_t>(count, 1))));
+        columns = static_cast<int>((maxX - minX) / cellSize) + 1;
+        rows = static_cast<int>((maxY - minY) / cellSize) + 1;
+        while (columns * rows > MAX_CELLS) {
+            cellSize *= 2;
+            columns = static_cast<int>((maxX - minX) / cellSize) + 1;
+            rows = static_cast<int>((maxY - minY) / cellSize) + 1;
+        }
+
+        int cellCount = columns * rows;
+        cellStart.assign(cellCount + 1, 0);
+        for (size_t i = 0; i < count; ++i) {
+            itemCell[i] = rowOf(points[i].y) * columns + columnOf(points[i].x);
+            cellStart[itemCell[i] + 1]++;
+        }
+        for (int cell = 0; cell < cellCount; ++cell) {
+            cellStart[cell + 1] += cellStart[cell];
+        }
+        cellCursor.assign(cellStart.begin(), cellStart.end() - 1);
+        for (size_t i = 0; i < count; ++i) {
+            items[cellCursor[itemCell[i]]++] = static_cast<uint32_t>(i);
+        }
+    }
+
+    template <typename Visitor>
+    void forEachInRadius(Vector2f center, float radius, Visitor visit) const {
+        if (points.empty()) return;
+        float radiusSq = radius * radius;
+        auto filter = [&](uint32_t item) {
+            float dx = points[item].x - center.x;
+            float dy = points[item].y - center.y;
+            float distanceSq = dx * dx + dy * dy;
+            if (distanceSq <= radiusSq) visit(item, distanceSq);
+        };
+        int firstColumn = columnOf(center.x - radius), lastColumn = columnOf(center.x + radius);
+        for (int row = rowOf(center.y - radius); row <= rowOf(center.y + radius); ++row) {
+            visitCells(firstColumn, lastColumn, row, filter);
+        }
+    }
+
+    size_t kNearest(Vector2f center, size_t k, float maxRadius, uint32_t* out, int32_t exclude = -1) const {
+        k = min(k, MAX_K);
+        if (points.empty() || k == 0) return 0;
+
+        float bestDistanceSq[MAX_K];
+        size_t found = 0;
+        float maxRadiusSq = maxRadius * maxRadius;
+        auto consider = [&](uint32_t item) {
+            if (static_cast<int32_t>(item) == exclude) return;
+            float dx = points[item].x - center.x;
+            float dy = points[item].y - center.y;
+            float distanceSq = dx * dx + dy * dy;
+            if (distanceSq > maxRadiusSq || (found == k && distanceSq >= bestDistanceSq[k - 1])) return;
+
+            size_t slot = found < k ? found++ : k - 1;
+            while (slot > 0 && bestDistanceSq[slot - 1] > distanceSq) {
+                bestDistanceSq[slot] = bestDistanceSq[slot - 1];
+                out[slot] = out[slot - 1];
+                slot--;
+            }
+            bestDistanceSq[slot] = distanceSq;
+            out[slot] = item;
+        };
+
+        if (maxRadius <= cellSize * 2) {
+            int firstColumn = columnOf(center.x - maxRadius), lastColumn = columnOf(center.x + maxRadius);
+            for (int row = rowOf(center.y - maxRadius); row <= rowOf(center.y + maxRadius); ++row) {
+                visitCells(firstColumn, lastColumn, row, consider);
+            }
+            return found;
+        }
+
+        int centerColumn = columnOf(center.x);
+        int centerRow = rowOf(center.y);
+        int maxRing = max(max(centerColumn, columns - 1 - centerColumn), max(centerRow, rows - 1 - centerRow));
+        for (int ring = 0; ring <= maxRing; ++ring) {
+            float ringDistance = (ring - 1) * cellSize;
+            if (ring > 0 && ringDistance > maxRadius) break;
+            if (found == k && ringDistance > 0 && ringDistance * ringDistance > bestDistanceSq[k - 1]) break;
+            visitRing(centerColumn, centerRow, ring, consider);
+        }
+        return found;
+    }
+
+    int32_t nearest(Vector2f center, float maxRadius) const {
+        uint32_t item = 0;
+        return kNearest(center, 1, maxRadius, &item) ? static_cast<int32_t>(item) : -1;
+    }
+
+    void nearestBatch(const Vector2f* centers, size_t count, float maxRadius, int32_t* out) const {
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = nearest(centers[i], maxRadius);
+        }
+    }
+
+    void kNearestBatch(const Vector2f* centers, size_t count, size_t k, float maxRadius,
+        uint32_t* out, uint32_t* counts, const int32_t* excludes = nullptr) const {
+        for (size_t i = 0; i < count; ++i) {
+            counts[i] = static_cast<uint32_t>(kNearest(centers[i], k, maxRadius, out + i * k,
+                excludes ? excludes[i] : -1));
+        }
+    }
+
+    size_t size() const { return points.size(); }
+};
+
+enum SimdLevel {
+    SIMD_SCALAR,
+    SIMD_SSE,
+    SIMD_AVX2
+};
+
+SimdLevel detectSimdLevel() {
+#if defined(SPACE_SHOOTER_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osSavesAvx = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osSavesAvx) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+    return avx2 ? SIMD_AVX2 : sse2 ? SIMD_SSE : SIMD_SCALAR;
+#elif defined(SPACE_SHOOTER_X86)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? SIMD_AVX2 : __builtin_cpu_supports("sse2") ? SIMD_SSE : SIMD_SCALAR;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+const char* simdLevelName(SimdLevel level) {
+    static const char* names[] = { "scalar", "SSE", "AVX2" };
+    return names[level];
+}
+
+class CircleBatch {
+private:
+    vector<float> xs;
+    vector<float> ys;
+    vector<float> radii;
+    size_t count;
+
+public:
+    static const size_t LANES = 16;
+    static constexpr float EMPTY_POSITION = 1e18f;
+
+    CircleBatch() : count(0) {}
+
+    void reserve(size_t capacity) {
+        size_t padded = (capacity + LANES - 1) / LANES * LANES;
+        xs.reserve(padded);
+        ys.reserve(padded);
+        radii.reserve(padded);
+    }
+
+    void clear() {
+        xs.clear();
+        ys.clear();
+        radii.clear();
+        count = 0;
+    }
+
+    void add(Vector2f position, float radius) {
+        xs.push_back(position.x);
+        ys.push_back(position.y);
+        radii.push_back(radius);
+        count++;
+    }
+
+    void addEmpty() {
+        add(Vector2f(EMPTY_POSITION, EMPTY_POSITION), 0);
+    }
+
+    void remove(size_t index) {
+        xs[index] = EMPTY_POSITION;
+        ys[index] = EMPTY_POSITION;
+        radii[index] = 0;
+    }
+
+    void finish() {
+        size_t real = count;
+        while (xs.size() % LANES != 0) {
+            addEmpty();
+        }
+        count = real;
+    }
+
+    size_t size() const { return count; }
+    size_t blockCount() const { return xs.size() / LANES; }
+    const float* getX() const { return xs.data(); }
+    const float* getY() const { return ys.data(); }
+    const float* getRadii() const { return radii.data(); }
+};
+
+typedef uint32_t (*OverlapMaskFunction)(const float* xs, const float* ys, const float* radii,
+    float x, float y, float radius);
+
+uint32_t overlapMaskScalar(const float* xs, const float* ys, const float* radii, float x, float y, float radius) {
+    uint32_t mask = 0;
+    for (size_t lane = 0; lane < CircleBatch::LANES; ++lane) {
+        float dx = xs[lane] - x;
+        float dy = ys[lane] - y;
+        float distanceSq = dx * dx;
+        distanceSq += dy * dy;
+        float reach = radii[lane] + radius;
+        if (distanceSq < reach * reach) {
+            mask |= 1u << lane;
+        }
+    }
+    return mask;
+}
+
+#ifdef SPACE_SHOOTER_X86
+SPACE_SHOOTER_TARGET_SSE
+uint32_t overlapMaskSse(const float* xs, const float* ys, const float* radii, float x, float y, float radius) {
+    __m128 px = _mm_set1_ps(x);
+    __m128 py = _mm_set1_ps(y);
+    __m128 pr = _mm_set1_ps(radius);
+    uint32_t mask = 0;
+    for (size_t lane = 0; lane < CircleBatch::LANES; lane += 4) {
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(xs + lane), px);
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(ys + lane), py);
+        __m128 distanceSq = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        __m128 reach = _mm_add_ps(_mm_loadu_ps(radii + lane), pr);
+        __m128 hit = _mm_cmplt_ps(distanceSq, _mm_mul_ps(reach, reach));
+        mask |= static_cast<uint32_t>(_mm_movemask_ps(hit)) << lane;
+    }
+    return mask;
+}
+
+SPACE_SHOOTER_TARGET_AVX2
+uint32_t overlapMaskAvx2(const float* xs, const float* ys, const float* radii, float x, float y, float radius) {
+    __m256 px = _mm256_set1_ps(x);
+    __m256 py = _mm256_set1_ps(y);
+    __m256 pr = _mm256_set1_ps(radius);
+    uint32_t mask = 0;
+    for (size_t lane = 0; lane < CircleBatch::LANES; lane += 8) {
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(xs + lane), px);
+        __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(ys + lane), py);
+        __m256 distanceSq = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+        __m256 reach = _mm256_add_ps(_mm256_loadu_ps(radii + lane), pr);
+        __m256 hit = _mm256_cmp_ps(distanceSq, _mm256_mul_ps(reach, reach), _CMP_LT_OQ);
+        mask |= static_cast<uint32_t>(_mm256_movemask_ps(hit)) << lane;
+    }
+    return mask;
+}
+#endif
+
+OverlapMaskFunction overlapMaskFunction(SimdLevel level) {
+#ifdef SPACE_SHOOTER_X86
+    if (level == SIMD_AVX2) return overlapMaskAvx2;
+    if (level == SIMD_SSE) return overlapMaskSse;
+#endif
+    return overlapMaskScalar;
+}
+
+class CircleNarrowphase {
+private:
+    SimdLevel level;
+    OverlapMaskFunction overlapMask;
+
+public:
+    CircleNarrowphase(SimdLevel level = detectSimdLevel()) : level(level), overlapMask(overlapMaskFunction(level)) {}
+
+    SimdLevel getLevel() const { return level; }
+
+    uint32_t mask(const CircleBatch& batch, size_t block, Vector2f position, float radius) const {
+        size_t offset = block * CircleBatch::LANES;
+        return overlapMask(batch.getX() + offset, batch.getY() + offset, batch.getRadii() + offset,
+            position.x, position.y, radius);
+    }
+
+    int32_t firstOverlap(const CircleBatch& batch, Vector2f position, float radius) const {
+        for (size_t block = 0; block < batch.blockCount(); ++block) {
+            uint32_t hits = mask(batch, block, position, radius);
+            if (hits) {
+                int32_t lane = 0;
+                while (!(hits & 1u)) {
+                    hits >>= 1;
+                    lane++;
+                }
+                return static_cast<int32_t>(block * CircleBatch::LANES) + lane;
+            }
+        }
+        return -1;
+    }
+};
+
+class ParticleSystem {
 private:
     struct Particle {
         Vector2f position;
@@ -43,13 +876,28 @@ private:
     };
 
     vector<Particle> particles;
-    VertexArray vertices;
     bool emitting;
     Vector2f emitterPosition;
+    int emissionRate;
+    size_t particleCap;
 
 public:
-    ParticleSystem() : vertices(Points), emitting(false), emitterPosition(0, 0) {
-        vertices.resize(1000);
+    ParticleSystem() : emitting(false), emitterPosition(0, 0), emissionRate(5), particleCap(500) {
+        particles.reserve(512);
+    }
+
+    void restart(Vector2f position) {
+        particles.clear();
+        emitterPosition = position;
+        emitting = true;
+    }
+
+    void setEmissionRate(int rate) {
+        emissionRate = rate;
+    }
+
+    void setParticleCap(size_t cap) {
+        particleCap = cap;
     }
 
     void setEmitter(Vector2f position) {
@@ -65,8 +913,9 @@ public:
     }
 
     void update(float deltaTime) {
-        if (emitting && particles.size() < 500) {
-            for (int i = 0; i < 5; ++i) {
+        if (emitting && particles.size() < particleCap) {
+            int count = min(emissionRate, static_cast<int>(particleCap - particles.size()));
+            for (int i = 0; i < count; ++i) {
                 Particle p;
                 p.position = emitterPosition;
                 float angle = (rand() % 360) * PI / 180.f;
@@ -85,27 +934,371 @@ public:
             particles[i].velocity.y += 100.f * deltaTime;
 
             if (particles[i].lifetime <= 0) {
-                particles.erase(particles.begin() + i);
+                particles[i] = particles.back();
+                particles.pop_back();
             }
             else {
                 ++i;
             }
         }
+    }
+
+    void appendVertices(vector<Vertex>& out) const {
+        for (const auto& particle : particles) {
+            Color particleColor = particle.color;
+            particleColor.a = static_cast<Uint8>(particle.lifetime / particle.maxLifetime * 255);
+            out.push_back(Vertex(particle.position, particleColor));
+        }
+    }
+
+    size_t getParticleCount() const { return particles.size(); }
+};
+
+inline double monotonicSeconds() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct QualitySettings {
+    int particleEmissionRate;
+    size_t particleCap;
+    size_t maxParticleSystems;
+    size_t starCount;
+    float effectScale;
+};
+
+class FrameBudgetGovernor {
+public:
+    static const int LEVEL_COUNT = 5;
+
+    struct Decision {
+        int fromLevel;
+        int toLevel;
+        float frameTime;
+        float tickTime;
+        double timestamp;
+    };
+
+private:
+    float budget;
+    float smoothedFrameTime;
+    float smoothedTickTime;
+    int level;
+    int overBudgetFrames;
+    int underBudgetFrames;
+    int framesSinceChange;
+    Decision lastDecision;
+    bool hasDecision;
+
+    static const QualitySettings& settingsFor(int level) {
+        static const QualitySettings table[LEVEL_COUNT] = {
+            { 1, 75, 3, 25, 0.2f },
+            { 2, 150, 5, 40, 0.4f },
+            { 3, 250, 7, 60, 0.6f },
+            { 4, 350, 9, 80, 0.8f },
+            { 5, 500, 11, 100, 1.0f }
+        };
+        return table[level];
+    }
+
+    void changeLevel(int newLevel) {
+        lastDecision.fromLevel = level;
+        lastDecision.toLevel = newLevel;
+        lastDecision.frameTime = smoothedFrameTime;
+        lastDecision.tickTime = smoothedTickTime;
+        lastDecision.timestamp = monotonicSeconds();
+        hasDecision = true;
+
+        level = newLevel;
+        overBudgetFrames = 0;
+        underBudgetFrames = 0;
+        framesSinceChange = 0;
+    }
+
+public:
+    explicit FrameBudgetGovernor(float budget = 1.0f / 60.f) : budget(budget),
+        smoothedFrameTime(0), smoothedTickTime(0), level(LEVEL_COUNT - 1),
+        overBudgetFrames(0), underBudgetFrames(0), framesSinceChange(0),
+        lastDecision(), hasDecision(false) {
+    }
+
+    void setBudget(float newBudget) {
+        budget = newBudget;
+        overBudgetFrames = 0;
+        underBudgetFrames = 0;
+    }
+
+    bool recordFrame(float frameTime, float tickTime) {
+        smoothedFrameTime += (frameTime - smoothedFrameTime) * 0.1f;
+        smoothedTickTime += (tickTime - smoothedTickTime) * 0.1f;
+        framesSinceChange++;
+
+        bool overBudget = smoothedFrameTime > budget * 0.9f || smoothedTickTime > budget * 0.5f;
+        bool underBudget = smoothedFrameTime < budget * 0.5f && smoothedTickTime < budget * 0.25f;
+        overBudgetFrames = overBudget ? overBudgetFrames + 1 : 0;
+        underBudgetFrames = underBudget ? underBudgetFrames + 1 : 0;
+
+        if (overBudgetFrames >= 10 && level > 0 && framesSinceChange >= 30) {
+            changeLevel(level - 1);
+            return true;
+        }
+        if (underBudgetFrames >= 180 && level < LEVEL_COUNT - 1) {
+            changeLevel(level + 1);
+            return true;
+        }
+        return false;
+    }
+
+    const QualitySettings& getSettings() const { return settingsFor(level); }
+    int getLevel() const { return level; }
+    float getBudget() const { return budget; }
+    float getSmoothedFrameTime() const { return smoothedFrameTime; }
+    float getSmoothedTickTime() const { return smoothedTickTime; }
+    bool hasLastDecision() const { return hasDecision; }
+    const Decision& getLastDecision() const { return lastDecision; }
+};
+
+class LatencyHistogram {
+public:
+    static const int BUCKET_COUNT = 200;
+
+private:
+    uint32_t buckets[BUCKET_COUNT + 1];
+    float bucketWidth;
+    uint32_t count;
+    double total;
+    float maxLatency;
+
+public:
+    explicit LatencyHistogram(float bucketWidth = 0.0005f) : bucketWidth(bucketWidth) {
+        clear();
+    }
+
+    void clear() {
+        fill(buckets, buckets + BUCKET_COUNT + 1, 0u);
+        count = 0;
+        total = 0;
+        maxLatency = 0;
+    }
+
+    void record(float latency) {
+        int bucket = min(static_cast<int>(max(latency, 0.0f) / bucketWidth), static_cast<int>(BUCKET_COUNT));
+        buckets[bucket]++;
+        count++;
+        total += latency;
+        maxLatency = max(maxLatency, latency);
+    }
+
+    float percentile(float fraction) const {
+        if (count == 0) return 0;
+        uint32_t target = static_cast<uint32_t>(ceil(count * fraction));
+        uint32_t seen = 0;
+        for (int i = 0; i <= BUCKET_COUNT; ++i) {
+            seen += buckets[i];
+            if (seen >= target) {
+                return (i + 1) * bucketWidth;
+            }
+        }
+        return maxLatency;
+    }
+
+    uint32_t getCount() const { return count; }
+    float getMean() const { return count ? static_cast<float>(total / count) : 0; }
+    float getMax() const { return maxLatency; }
+
+    void print(ostream& out, const char* title) const {
+        out << title << ": " << count << " samples, mean " << getMean() * 1000 << " ms, p50 "
+            << percentile(0.5f) * 1000 << " ms, p99 " << percentile(0.99f) * 1000 << " ms, max "
+            << maxLatency * 1000 << " ms" << endl;
+
+        uint32_t peak = *max_element(buckets, buckets + BUCKET_COUNT + 1);
+        for (int i = 0; i <= BUCKET_COUNT; ++i) {
+            if (buckets[i] == 0) continue;
+            out << "  ";
+            if (i == BUCKET_COUNT) {
+                out << ">=" << BUCKET_COUNT * bucketWidth * 1000 << " ms";
+            }
+            else {
+                out << i * bucketWidth * 1000 << "-" << (i + 1) * bucketWidth * 1000 << " ms";
+            }
+            out << "\t" << buckets[i] << "\t" << string(buckets[i] * 40 / peak + 1, '#') << endl;
+        }
+    }
+};
+
+struct InputSample {
+    PlayerInput input;
+    double changeTime;
+    bool changed;
+    InputSample() : changeTime(0), changed(false) {}
+};
+
+class InputSampler {
+private:
+    enum Button {
+        BUTTON_LEFT = 1,
+        BUTTON_RIGHT = 2,
+        BUTTON_UP = 4,
+        BUTTON_DOWN = 8,
+        BUTTON_FIRE = 16
+    };
+
+    thread samplerThread;
+    atomic<bool> running;
+    mutex sampleMutex;
+    unsigned state;
+    unsigned pressedSinceTake;
+    double firstChangeTime;
+    bool changePending;
+
+    static unsigned pollButtons() {
+        unsigned buttons = 0;
+        if (Keyboard::isKeyPressed(Keyboard::A) || Keyboard::isKeyPressed(Keyboard::Left)) buttons |= BUTTON_LEFT;
+        if (Keyboard::isKeyPressed(Keyboard::D) || Keyboard::isKeyPressed(Keyboard::Right)) buttons |= BUTTON_RIGHT;
+        if (Keyboard::isKeyPressed(Keyboard::W) || Keyboard::isKeyPressed(Keyboard::Up)) buttons |= BUTTON_UP;
+        if (Keyboard::isKeyPressed(Keyboard::S) || Keyboard::isKeyPressed(Keyboard::Down)) buttons |= BUTTON_DOWN;
+        if (Keyboard::isKeyPressed(Keyboard::Space)) buttons |= BUTTON_FIRE;
+        return buttons;
+    }
+
+    void samplerLoop() {
+        while (running) {
+            unsigned buttons = pollButtons();
+            double now = monotonicSeconds();
+            {
+                lock_guard<mutex> lock(sampleMutex);
+                if (buttons != state) {
+                    pressedSinceTake |= buttons & ~state;
+                    state = buttons;
+                    if (!changePending) {
+                        firstChangeTime = now;
+                        changePending = true;
+                    }
+                }
+            }
+            this_thread::sleep_for(chrono::microseconds(500));
+        }
+    }
+
+public:
+    InputSampler() : running(true), state(0), pressedSinceTake(0),
+        firstChangeTime(0), changePending(false) {
+        samplerThread = thread(&InputSampler::samplerLoop, this);
+    }
+
+    ~InputSampler() {
+        running = false;
+        samplerThread.join();
+    }
+
+    InputSampler(const InputSampler&) = delete;
+    InputSampler& operator=(const InputSampler&) = delete;
+
+    InputSample take() {
+        unsigned buttons;
+        InputSample sample;
+        {
+            lock_guard<mutex> lock(sampleMutex);
+            buttons = state | pressedSinceTake;
+            sample.changed = changePending;
+            sample.changeTime = firstChangeTime;
+            pressedSinceTake = 0;
+            changePending = false;
+        }
+
+        if (buttons & BUTTON_LEFT) sample.input.moveX = -1;
+        if (buttons & BUTTON_RIGHT) sample.input.moveX = 1;
+        if (buttons & BUTTON_UP) sample.input.moveY = -1;
+        if (buttons & BUTTON_DOWN) sample.input.moveY = 1;
+        sample.input.fire = (buttons & BUTTON_FIRE) != 0;
+        return sample;
+    }
+};
+
+class FramePacer {
+private:
+    double targetInterval;
+    double refreshInterval;
+    double nextDeadline;
+    double lastFrameTime;
+    double spinMargin;
+    double averageOversleep;
+    LatencyHistogram jitter;
+    LatencyHistogram intervals;
+
+    void sleepUntil(double deadline) {
+        double now = monotonicSeconds();
+        if (deadline - now > spinMargin) {
+            double requested = deadline - spinMargin - now;
+            this_thread::sleep_for(chrono::duration<double>(requested));
+            double overslept = monotonicSeconds() - now - requested;
+            averageOversleep += (max(overslept, 0.0) - averageOversleep) * 0.05;
+            spinMargin = max(0.0005, averageOversleep * 2);
+        }
+        while (monotonicSeconds() < deadline) {
+            this_thread::yield();
+        }
+    }
+
+public:
+    explicit FramePacer(unsigned targetRate = 60) : targetInterval(0), refreshInterval(0),
+        nextDeadline(0), lastFrameTime(0), spinMargin(0.002), averageOversleep(0.001),
+        jitter(0.00005f), intervals(0.0005f) {
+        setTargetRate(targetRate);
+    }
+
+    void setTargetRate(unsigned rate) {
+        targetInterval = rate > 0 ? 1.0 / rate : 0;
+        nextDeadline = 0;
+        jitter.clear();
+        intervals.clear();
+    }
+
+    void setRefreshRate(unsigned rate) {
+        refreshInterval = rate > 0 ? 1.0 / rate : 0;
+    }
 
-        vertices.clear();
-        vertices.resize(particles.size());
-        for (size_t i = 0; i < particles.size(); ++i) {
-            float alpha = particles[i].lifetime / particles[i].maxLifetime;
-            Color particleColor = particles[i].color;
-            particleColor.a = static_cast<Uint8>(alpha * 255);
-            vertices[i].position = particles[i].position;
-            vertices[i].color = particleColor;
+    bool pacesFrames() const {
+        return targetInterval > refreshInterval;
+    }
+
+    void wait() {
+        if (pacesFrames()) {
+            double now = monotonicSeconds();
+            if (nextDeadline == 0 || now - nextDeadline > targetInterval) {
+                nextDeadline = now + targetInterval;
+            }
+            sleepUntil(nextDeadline);
+            nextDeadline += targetInterval;
+        }
+
+        double frameTime = monotonicSeconds();
+        if (lastFrameTime > 0) {
+            double interval = frameTime - lastFrameTime;
+            intervals.record(static_cast<float>(interval));
+            if (targetInterval > 0) {
+                jitter.record(static_cast<float>(fabs(interval - targetInterval)));
+            }
         }
+        lastFrameTime = frameTime;
+    }
+
+    float getTickDelta(float measured) const {
+        if (refreshInterval <= 0) return measured;
+        double refreshes = max(1.0, floor(measured / refreshInterval + 0.5));
+        return static_cast<float>(refreshes * refreshInterval);
     }
 
-    void draw(RenderTarget& target, RenderStates states) const override {
-        target.draw(vertices, states);
+    unsigned getTargetRate() const {
+        return targetInterval > 0 ? static_cast<unsigned>(1.0 / targetInterval + 0.5) : 0;
     }
+
+    float getBudget() const {
+        return static_cast<float>(targetInterval > 0 ? targetInterval : 1.0 / 60);
+    }
+
+    bool isAlignedToRefresh() const { return refreshInterval > 0; }
+    const LatencyHistogram& getJitter() const { return jitter; }
+    const LatencyHistogram& getIntervals() const { return intervals; }
 };
 
 class PlayerShip {
@@ -119,14 +1312,16 @@ private:
     float shootCooldown;
     float maxShootCooldown;
     int score;
-    Clock invincibilityClock;
+    float invincibilityTimer;
     bool isInvincible;
+    bool shielded;
+    uint64_t hashValue;
 
 public:
-    PlayerShip() : position(WINDOW_WIDTH / 2, WINDOW_HEIGHT - 100),
+    PlayerShip(float viewTop = 0) : position(WINDOW_WIDTH / 2, viewTop + WINDOW_HEIGHT - 100),
         velocity(0, 0), speed(500.f), health(100), isAlive(true),
-        shootCooldown(0), maxShootCooldown(0.2f), score(0),
-        isInvincible(false) {
+        shootCooldown(0), maxShootCooldown(BASE_SHOOT_COOLDOWN), score(0),
+        invincibilityTimer(0), isInvincible(false), shielded(false), hashValue(0) {
         shape.setSize(Vector2f(60, 40));
         shape.setFillColor(Color::Green);
         shape.setOutlineThickness(2);
@@ -135,35 +1330,22 @@ public:
         shape.setPosition(position);
     }
 
-    void update(float deltaTime) {
+    void update(float deltaTime, const PlayerInput& input, float viewTop, float scrolled) {
         if (!isAlive) return;
 
-        velocity.x = 0;
-        velocity.y = 0;
-
-        if (Keyboard::isKeyPressed(Keyboard::A) || Keyboard::isKeyPressed(Keyboard::Left)) {
-            velocity.x = -speed;
-        }
-        if (Keyboard::isKeyPressed(Keyboard::D) || Keyboard::isKeyPressed(Keyboard::Right)) {
-            velocity.x = speed;
-        }
-        if (Keyboard::isKeyPressed(Keyboard::W) || Keyboard::isKeyPressed(Keyboard::Up)) {
-            velocity.y = -speed;
-        }
-        if (Keyboard::isKeyPressed(Keyboard::S) || Keyboard::isKeyPressed(Keyboard::Down)) {
-            velocity.y = speed;
-        }
+        velocity.x = input.moveX * speed;
+        velocity.y = input.moveY * speed;
 
         position.x += velocity.x * deltaTime;
-        position.y += velocity.y * deltaTime;
+        position.y += velocity.y * deltaTime - scrolled;
 
         float halfWidth = shape.getSize().x / 2;
         float halfHeight = shape.getSize().y / 2;
 
         if (position.x < halfWidth) position.x = halfWidth;
         if (position.x > WINDOW_WIDTH - halfWidth) position.x = WINDOW_WIDTH - halfWidth;
-        if (position.y < halfHeight) position.y = halfHeight;
-        if (position.y > WINDOW_HEIGHT - halfHeight) position.y = WINDOW_HEIGHT - halfHeight;
+        if (position.y < viewTop + halfHeight) position.y = viewTop + halfHeight;
+        if (position.y > viewTop + WINDOW_HEIGHT - halfHeight) position.y = viewTop + WINDOW_HEIGHT - halfHeight;
 
         shape.setPosition(position);
 
@@ -171,9 +1353,12 @@ public:
             shootCooldown -= deltaTime;
         }
 
-        if (isInvincible && invincibilityClock.getElapsedTime().asSeconds() > 1.5f) {
-            isInvincible = false;
-            shape.setFillColor(Color::Green);
+        if (isInvincible) {
+            invincibilityTimer += deltaTime;
+            if (invincibilityTimer > 1.5f) {
+                isInvincible = false;
+                shape.setFillColor(Color::Green);
+            }
         }
     }
 
@@ -185,18 +1370,24 @@ public:
         shootCooldown = maxShootCooldown;
     }
 
-    CircleShape createBullet() const {
-        CircleShape bullet(5);
-        bullet.setFillColor(Color::Yellow);
-        bullet.setOutlineColor(Color::Red);
-        bullet.setOutlineThickness(2);
-        bullet.setOrigin(5, 5);
-        bullet.setPosition(position.x, position.y - 30);
-        return bullet;
+    Bullet createBullet(float spreadX = 0) const {
+        return Bullet(Vector2f(position.x, position.y - 30), Vector2f(spreadX, -800), 5);
+    }
+
+    Bullet createMissile(float side) const {
+        return Bullet(Vector2f(position.x + side * 24, position.y - 10), Vector2f(side * 180, -480), 4);
+    }
+
+    void setMaxShootCooldown(float cooldown) {
+        maxShootCooldown = cooldown;
+    }
+
+    void setShielded(bool enabled) {
+        shielded = enabled;
     }
 
     void takeDamage(int damage) {
-        if (isInvincible) return;
+        if (isInvincible || shielded) return;
 
         health -= damage;
         if (health <= 0) {
@@ -206,249 +1397,3979 @@ public:
         }
         else {
             isInvincible = true;
-            invincibilityClock.restart();
+            invincibilityTimer = 0;
             shape.setFillColor(Color(255, 100, 100, 150));
         }
     }
 
-    void addScore(int points) {
-        score += points;
+    void addScore(int points) {
+        score += points;
+    }
+
+    void restore(Vector2f newPosition, int newHealth, int newScore, float cooldown, bool invincible) {
+        position = newPosition;
+        health = newHealth;
+        score = newScore;
+        shootCooldown = cooldown;
+        isAlive = health > 0;
+        isInvincible = invincible && isAlive;
+        shape.setPosition(position);
+        shape.setFillColor(!isAlive ? Color::Transparent : isInvincible ? Color(255, 100, 100, 150) : Color::Green);
+    }
+
+    void heal(int amount) {
+        health += amount;
+        if (health > 100) health = 100;
+    }
+
+    uint64_t computeHash() const {
+        return entityStateHash(ENTITY_PLAYER, (isAlive ? 1u : 0u) | (isInvincible ? 2u : 0u) | (shielded ? 4u : 0u),
+            packFloats(position.x, position.y), packInts(health, score),
+            hashCombine(packFloats(shootCooldown, invincibilityTimer), packFloats(maxShootCooldown, 0)));
+    }
+
+    uint64_t rehash() {
+        uint64_t previous = hashValue;
+        hashValue = computeHash();
+        return previous ^ hashValue;
+    }
+
+    const RectangleShape& getShape() const { return shape; }
+    const Vector2f& getPosition() const { return position; }
+    const Velocity& getVelocity() const { return velocity; }
+    int getHealth() const { return health; }
+    bool getIsAlive() const { return isAlive; }
+    bool getIsInvincible() const { return isInvincible; }
+    bool getIsShielded() const { return shielded; }
+    int getScore() const { return score; }
+    float getShootCooldown() const { return shootCooldown; }
+    float getMaxShootCooldown() const { return maxShootCooldown; }
+};
+
+enum EnemyArchetypeId {
+    ENEMY_GRUNT,
+    ENEMY_SCOUT,
+    ENEMY_TANK,
+    ENEMY_KAMIKAZE,
+    ENEMY_SWARMER,
+    ENEMY_BOSS,
+    ENEMY_ARCHETYPE_COUNT
+};
+
+struct EnemyStats {
+    float radius;
+    int health;
+    int damage;
+    int points;
+    float shootInterval;
+    Uint8 fill[3];
+    Uint8 outline[3];
+    bool tintsWithDamage;
+};
+
+constexpr EnemyStats ENEMY_STATS[ENEMY_ARCHETYPE_COUNT] = {
+    { 20, 50, 10, 100, 2.0f, { 255, 0, 0 }, { 255, 100, 100 }, false },
+    { 14, 20, 8, 120, 2.5f, { 80, 200, 255 }, { 180, 240, 255 }, false },
+    { 28, 150, 25, 250, 3.0f, { 120, 120, 140 }, { 200, 200, 220 }, false },
+    { 16, 30, 35, 150, 0.0f, { 255, 140, 0 }, { 255, 220, 120 }, false },
+    { 10, 15, 12, 40, 0.0f, { 170, 255, 90 }, { 230, 255, 180 }, false },
+    { 40, 500, 30, 500, 1.5f, { 200, 50, 50 }, { 255, 0, 0 }, true }
+};
+
+const int MAX_ENEMY_VOLLEY = 3;
+
+struct EnemyContext {
+    Vector2f target;
+    float viewTop;
+    float scrolled;
+    EnemyContext(Vector2f target = Vector2f(0, 0), float viewTop = 0, float scrolled = 0)
+        : target(target), viewTop(viewTop), scrolled(scrolled) {}
+};
+
+struct AiContext {
+    Vector2f playerPosition;
+    Vector2f playerVelocity;
+    float viewTop;
+    const vector<Bullet>& playerBullets;
+    const SpatialGrid& bulletGrid;
+    AiContext(Vector2f playerPosition, Vector2f playerVelocity, float viewTop, const vector<Bullet>& playerBullets,
+        const SpatialGrid& bulletGrid)
+        : playerPosition(playerPosition), playerVelocity(playerVelocity), viewTop(viewTop),
+        playerBullets(playerBullets), bulletGrid(bulletGrid) {}
+};
+
+class EnemyShip {
+private:
+    Vector2f position;
+    Velocity velocity;
+    int health;
+    float shootTimer;
+    float thinkTimer;
+    float desiredSpeedX;
+    float leadOffset;
+    Vector2f aim;
+    uint8_t archetype;
+    bool levelPlaced;
+    bool steering;
+    uint32_t id;
+    uint64_t hashValue;
+
+    template <int Archetype> friend struct EnemyArchetype;
+
+public:
+    EnemyShip(EnemyArchetypeId archetype, Vector2f position, Velocity velocity)
+        : position(position), velocity(velocity), health(ENEMY_STATS[archetype].health), shootTimer(0),
+        thinkTimer(0), desiredSpeedX(0), leadOffset(0), aim(0, 1), archetype(static_cast<uint8_t>(archetype)),
+        levelPlaced(false), steering(false), id(0), hashValue(0) {}
+
+    void placeInLevel(Vector2f levelPosition) {
+        position = levelPosition;
+        levelPlaced = true;
+    }
+
+    void translate(Vector2f offset) {
+        position += offset;
+    }
+
+    void setVelocity(const Velocity& newVelocity) {
+        velocity = newVelocity;
+    }
+
+    void drift(float deltaTime) {
+        float radius = getRadius();
+        position.x += velocity.x * deltaTime;
+        position.y += velocity.y * deltaTime;
+
+        if (position.x < radius) {
+            position.x = radius;
+            velocity.x = -velocity.x;
+        }
+        if (position.x > WINDOW_WIDTH - radius) {
+            position.x = WINDOW_WIDTH - radius;
+            velocity.x = -velocity.x;
+        }
+    }
+
+    void resetShootTimer() {
+        shootTimer = 0;
+    }
+
+    float advanceThinkTimer(float deltaTime) {
+        thinkTimer += deltaTime;
+        return thinkTimer;
+    }
+
+    void resetThinkTimer() {
+        thinkTimer = 0;
+    }
+
+    void aimAt(Vector2f target) {
+        Vector2f direction = target - position;
+        direction.y = max(direction.y, fabs(direction.x) * 0.25f + 1);
+        aim = direction / sqrt(direction.x * direction.x + direction.y * direction.y);
+    }
+
+    void steerHorizontally(float speedX) {
+        desiredSpeedX = speedX;
+        steering = true;
+    }
+
+    void stopSteering() {
+        steering = false;
+    }
+
+    void takeDamage(int damage) {
+        health -= damage;
+    }
+
+    bool isAlive() const {
+        return health > 0;
+    }
+
+    bool isOffScreen(float viewTop) const {
+        return position.y > viewTop + WINDOW_HEIGHT + 100;
+    }
+
+    uint64_t computeHash() const {
+        return entityStateHash(ENTITY_ENEMY, id, packFloats(position.x, position.y),
+            packFloats(velocity.x, velocity.y), hashCombine(packFloats(shootTimer, static_cast<float>(health)),
+            hashCombine(packFloats(thinkTimer, steering ? desiredSpeedX : -1e9f),
+            hashCombine(packFloats(aim.x, aim.y), packFloats(leadOffset, 0)))));
+    }
+
+    uint64_t rehash() {
+        uint64_t previous = hashValue;
+        hashValue = computeHash();
+        return previous ^ hashValue;
+    }
+
+    void setId(uint32_t newId) { id = newId; }
+    uint32_t getId() const { return id; }
+    uint64_t getHash() const { return hashValue; }
+
+    FloatRect getBounds() const {
+        float extent = getRadius() + 2;
+        return FloatRect(position.x - extent, position.y - extent, extent * 2, extent * 2);
+    }
+
+    Color getFillColor() const {
+        const EnemyStats& stats = ENEMY_STATS[archetype];
+        float shade = stats.tintsWithDamage ? static_cast<float>(health) / stats.health : 1.0f;
+        return Color(stats.fill[0], static_cast<Uint8>(stats.fill[1] * shade), static_cast<Uint8>(stats.fill[2] * shade));
+    }
+
+    Color getOutlineColor() const {
+        const EnemyStats& stats = ENEMY_STATS[archetype];
+        return Color(stats.outline[0], stats.outline[1], stats.outline[2]);
+    }
+
+    const Vector2f& getPosition() const { return position; }
+    EnemyArchetypeId getArchetype() const { return static_cast<EnemyArchetypeId>(archetype); }
+    bool isLevelPlaced() const { return levelPlaced; }
+    int getDamage() const { return ENEMY_STATS[archetype].damage; }
+    int getPoints() const { return ENEMY_STATS[archetype].points; }
+    int getHealth() const { return health; }
+    int getMaxHealth() const { return ENEMY_STATS[archetype].health; }
+    bool getIsBoss() const { return archetype == ENEMY_BOSS; }
+    float getRadius() const { return ENEMY_STATS[archetype].radius; }
+};
+
+const float DODGE_RADIUS = 140.f;
+
+inline float dodgeDirection(const EnemyShip& enemy, const AiContext& context) {
+    Vector2f position = enemy.getPosition();
+    float reach = enemy.getRadius() + 12;
+    float nearest = DODGE_RADIUS * DODGE_RADIUS;
+    float direction = 0;
+    context.bulletGrid.forEachInRadius(position, DODGE_RADIUS, [&](uint32_t i, float distanceSq) {
+        const Bullet& bullet = context.playerBullets[i];
+        float dx = position.x - bullet.position.x;
+        if (bullet.position.y > position.y && fabs(dx) < reach + bullet.radius && distanceSq < nearest) {
+            nearest = distanceSq;
+            direction = dx < 0 ? -1.f : 1.f;
+        }
+    });
+    if ((direction < 0 && position.x < reach * 2) || (direction > 0 && position.x > WINDOW_WIDTH - reach * 2)) {
+        direction = -direction;
+    }
+    return direction;
+}
+
+inline Vector2f leadTarget(Vector2f from, const AiContext& context, float projectileSpeed) {
+    Vector2f offset = context.playerPosition - from;
+    float time = sqrt(offset.x * offset.x + offset.y * offset.y) / projectileSpeed;
+    return context.playerPosition + context.playerVelocity * min(time, 1.5f);
+}
+
+template <int Archetype>
+struct EnemyArchetype {
+    static const bool SHOOTS = true;
+
+    static EnemyShip spawn(Random& rng) {
+        EnemyShip enemy(static_cast<EnemyArchetypeId>(Archetype), Vector2f(0, 0), Velocity(0, 0));
+        enemy.velocity = Velocity(rng.nextInt(100) - 50, rng.nextInt(50) + 50);
+        enemy.position = Vector2f(rng.nextInt(WINDOW_WIDTH - 100) + 50, -50);
+        enemy.shootTimer = rng.nextInt(100) / 100.f * ENEMY_STATS[Archetype].shootInterval;
+        return enemy;
+    }
+
+    static const int THINK_COST = 3;
+    static const int FORMATION_SLOTS = 8;
+
+    static void think(EnemyShip& enemy, const AiContext& context) {
+        float dodge = dodgeDirection(enemy, context);
+        if (dodge != 0) {
+            enemy.steerHorizontally(dodge * 160);
+        }
+        else {
+            float slot = (enemy.id * 5 % FORMATION_SLOTS + 0.5f) * WINDOW_WIDTH / FORMATION_SLOTS;
+            enemy.steerHorizontally(max(-80.f, min(80.f, (slot - enemy.position.x) * 1.5f)));
+        }
+        enemy.aimAt(leadTarget(enemy.position, context, 400));
+    }
+
+    static void update(EnemyShip& enemy, float deltaTime, const EnemyContext&) {
+        if (enemy.steering) {
+            enemy.velocity.x += (enemy.desiredSpeedX - enemy.velocity.x) * min(1.0f, 4 * deltaTime);
+        }
+        enemy.drift(deltaTime);
+        enemy.shootTimer += deltaTime;
+    }
+
+    static bool canShoot(const EnemyShip& enemy) {
+        return enemy.shootTimer >= ENEMY_STATS[Archetype].shootInterval;
+    }
+
+    static int fire(const EnemyShip& enemy, Bullet* volley) {
+        volley[0] = Bullet(enemy.position + enemy.aim * (ENEMY_STATS[Archetype].radius + 10), enemy.aim * 400.f, 4);
+        return 1;
+    }
+};
+
+template <>
+struct EnemyArchetype<ENEMY_SCOUT> : EnemyArchetype<ENEMY_GRUNT> {
+    static EnemyShip spawn(Random& rng) {
+        EnemyShip enemy(ENEMY_SCOUT, Vector2f(0, 0), Velocity(0, 0));
+        float sideways = static_cast<float>(rng.nextInt(80) + 100);
+        enemy.velocity = Velocity(rng.nextInt(2) ? sideways : -sideways, rng.nextInt(60) + 120);
+        enemy.position = Vector2f(rng.nextInt(WINDOW_WIDTH - 100) + 50, -50);
+        enemy.shootTimer = rng.nextInt(100) / 100.f * ENEMY_STATS[ENEMY_SCOUT].shootInterval;
+        return enemy;
+    }
+
+    static void think(EnemyShip& enemy, const AiContext& context) {
+        float dodge = dodgeDirection(enemy, context);
+        if (dodge != 0) {
+            enemy.steerHorizontally(dodge * 240);
+        }
+        else {
+            enemy.stopSteering();
+        }
+        enemy.aimAt(leadTarget(enemy.position, context, 480));
+    }
+
+    static bool canShoot(const EnemyShip& enemy) {
+        return enemy.shootTimer >= ENEMY_STATS[ENEMY_SCOUT].shootInterval;
+    }
+
+    static int fire(const EnemyShip& enemy, Bullet* volley) {
+        volley[0] = Bullet(enemy.position + enemy.aim * (ENEMY_STATS[ENEMY_SCOUT].radius + 10), enemy.aim * 480.f, 3);
+        return 1;
+    }
+};
+
+template <>
+struct EnemyArchetype<ENEMY_TANK> : EnemyArchetype<ENEMY_GRUNT> {
+    static EnemyShip spawn(Random& rng) {
+        EnemyShip enemy(ENEMY_TANK, Vector2f(0, 0), Velocity(0, 0));
+        enemy.velocity = Velocity(rng.nextInt(40) - 20, rng.nextInt(15) + 30);
+        enemy.position = Vector2f(rng.nextInt(WINDOW_WIDTH - 100) + 50, -50);
+        enemy.shootTimer = rng.nextInt(100) / 100.f * ENEMY_STATS[ENEMY_TANK].shootInterval;
+        return enemy;
+    }
+
+    static const int THINK_COST = 1;
+
+    static void think(EnemyShip& enemy, const AiContext& context) {
+        enemy.aimAt(leadTarget(enemy.position, context, 320));
+    }
+
+    static bool canShoot(const EnemyShip& enemy) {
+        return enemy.shootTimer >= ENEMY_STATS[ENEMY_TANK].shootInterval;
+    }
+
+    static int fire(const EnemyShip& enemy, Bullet* volley) {
+        Vector2f muzzle = enemy.position + enemy.aim * (ENEMY_STATS[ENEMY_TANK].radius + 10);
+        Vector2f side(enemy.aim.y * 12, -enemy.aim.x * 12);
+        volley[0] = Bullet(muzzle - side, enemy.aim * 320.f, 5);
+        volley[1] = Bullet(muzzle + side, enemy.aim * 320.f, 5);
+        return 2;
+    }
+};
+
+template <>
+struct EnemyArchetype<ENEMY_KAMIKAZE> {
+    static const bool SHOOTS = false;
+    static const int THINK_COST = 1;
+
+    static EnemyShip spawn(Random& rng) {
+        EnemyShip enemy(ENEMY_KAMIKAZE, Vector2f(0, 0), Velocity(0, 0));
+        enemy.velocity = Velocity(0, rng.nextInt(40) + 160);
+        enemy.position = Vector2f(rng.nextInt(WINDOW_WIDTH - 100) + 50, -50);
+        return enemy;
+    }
+
+    static void think(EnemyShip& enemy, const AiContext& context) {
+        float closing = max(50.f, enemy.velocity.y - context.playerVelocity.y);
+        float time = min(1.5f, max(0.f, context.playerPosition.y - enemy.position.y) / closing);
+        enemy.leadOffset = context.playerVelocity.x * time;
+    }
+
+    static void update(EnemyShip& enemy, float deltaTime, const EnemyContext& context) {
+        float targetX = max(0.f, min(static_cast<float>(WINDOW_WIDTH), context.target.x + enemy.leadOffset));
+        float steer = max(-400.f, min(400.f, (targetX - enemy.position.x) * 3));
+        enemy.velocity.x = max(-250.f, min(250.f, enemy.velocity.x + steer * deltaTime));
+        enemy.velocity.y += 120 * deltaTime;
+        enemy.drift(deltaTime);
+    }
+
+    static bool canShoot(const EnemyShip&) {
+        return false;
+    }
+
+    static int fire(const EnemyShip&, Bullet*) {
+        return 0;
+    }
+};
+
+template <>
+struct EnemyArchetype<ENEMY_SWARMER> : EnemyArchetype<ENEMY_KAMIKAZE> {
+    static const int NEIGHBORS = 6;
+    static const int THINK_COST = 0;
+
+    static void think(EnemyShip&, const AiContext&) {}
+
+    static EnemyShip spawn(Random& rng) {
+        EnemyShip enemy(ENEMY_SWARMER, Vector2f(0, 0), Velocity(0, 0));
+        enemy.velocity = Velocity(rng.nextInt(60) - 30, 110);
+        enemy.position = Vector2f(rng.nextInt(WINDOW_WIDTH - 200) + 100, -50);
+        return enemy;
+    }
+
+    static void update(EnemyShip& enemy, float deltaTime, const EnemyContext&) {
+        enemy.drift(deltaTime);
+    }
+
+    static Velocity flock(const EnemyShip& self, const EnemyShip* swarm, const uint32_t* neighbors, size_t count,
+        const Vector2f& target, float deltaTime) {
+        Vector2f velocity(self.velocity.x, self.velocity.y);
+        Vector2f separation(0, 0), heading(0, 0), center(0, 0);
+        for (size_t i = 0; i < count; ++i) {
+            const EnemyShip& other = swarm[neighbors[i]];
+            Vector2f offset = self.position - other.position;
+            float distance = max(1.0f, sqrt(offset.x * offset.x + offset.y * offset.y));
+            if (distance < 30) {
+                separation += offset * ((30 - distance) / (30 * distance));
+            }
+            heading += Vector2f(other.velocity.x, other.velocity.y);
+            center += other.position;
+        }
+
+        Vector2f acceleration = separation * 600.f + Vector2f((target.x - self.position.x) * 0.4f, 30);
+        if (count > 0) {
+            float inverse = 1.0f / count;
+            acceleration += (heading * inverse - velocity) * 1.5f + (center * inverse - self.position) * 0.8f;
+        }
+
+        velocity += acceleration * deltaTime;
+        float speed = sqrt(velocity.x * velocity.x + velocity.y * velocity.y);
+        float clamped = max(60.f, min(200.f, speed));
+        if (speed > 0) {
+            velocity *= clamped / speed;
+        }
+        return Velocity(velocity.x, max(40.f, velocity.y));
+    }
+};
+
+template <>
+struct EnemyArchetype<ENEMY_BOSS> {
+    static const bool SHOOTS = true;
+    static const int THINK_COST = 1;
+
+    static void think(EnemyShip& enemy, const AiContext& context) {
+        enemy.aimAt(leadTarget(enemy.position, context, 400));
+    }
+
+    static int phase(const EnemyShip& enemy) {
+        int maxHealth = ENEMY_STATS[ENEMY_BOSS].health;
+        return enemy.health * 3 > maxHealth * 2 ? 0 : (enemy.health * 3 > maxHealth ? 1 : 2);
+    }
+
+    static float shootInterval(const EnemyShip& enemy) {
+        static const float intervals[3] = { 1.5f, 1.0f, 0.7f };
+        return intervals[phase(enemy)];
+    }
+
+    static EnemyShip spawn(Random& rng) {
+        EnemyShip enemy(ENEMY_BOSS, Vector2f(0, 0), Velocity(0, 50));
+        enemy.position = Vector2f(rng.nextInt(WINDOW_WIDTH - 100) + 50, -50);
+        enemy.shootTimer = rng.nextInt(100) / 100.f * ENEMY_STATS[ENEMY_BOSS].shootInterval;
+        return enemy;
+    }
+
+    static void update(EnemyShip& enemy, float deltaTime, const EnemyContext& context) {
+        float hoverY = context.viewTop + 150;
+        if (enemy.position.y < hoverY) {
+            enemy.position.y = min(hoverY, enemy.position.y + enemy.velocity.y * deltaTime);
+        }
+        else {
+            float speed = 60.f + 60.f * phase(enemy);
+            enemy.velocity.x = enemy.velocity.x < 0 ? -speed : speed;
+            enemy.drift(deltaTime);
+            enemy.position.y = hoverY;
+        }
+        enemy.shootTimer += deltaTime;
+    }
+
+    static bool canShoot(const EnemyShip& enemy) {
+        return enemy.shootTimer >= shootInterval(enemy);
+    }
+
+    static int fire(const EnemyShip& enemy, Bullet* volley) {
+        static const float spreads[MAX_ENEMY_VOLLEY] = { 0, -120, 120 };
+        Vector2f muzzle(enemy.position.x, enemy.position.y + ENEMY_STATS[ENEMY_BOSS].radius + 10);
+        int count = phase(enemy) + 1;
+        for (int i = 0; i < count; ++i) {
+            volley[i] = Bullet(muzzle, enemy.aim * 400.f + Vector2f(spreads[i], 0), 4);
+        }
+        return count;
+    }
+};
+
+template <int Archetype>
+inline int stepEnemy(EnemyShip& enemy, float deltaTime, const EnemyContext& context, Bullet* volley) {
+    typedef EnemyArchetype<Archetype> Traits;
+    Traits::update(enemy, deltaTime, context);
+    if (Traits::SHOOTS && Traits::canShoot(enemy) && enemy.isAlive()) {
+        enemy.resetShootTimer();
+        return Traits::fire(enemy, volley);
+    }
+    return 0;
+}
+
+inline int stepEnemyDispatched(EnemyShip& enemy, float deltaTime, const EnemyContext& context, Bullet* volley) {
+    switch (enemy.getArchetype()) {
+    case ENEMY_SCOUT:
+        return stepEnemy<ENEMY_SCOUT>(enemy, deltaTime, context, volley);
+    case ENEMY_TANK:
+        return stepEnemy<ENEMY_TANK>(enemy, deltaTime, context, volley);
+    case ENEMY_KAMIKAZE:
+        return stepEnemy<ENEMY_KAMIKAZE>(enemy, deltaTime, context, volley);
+    case ENEMY_SWARMER:
+        return stepEnemy<ENEMY_SWARMER>(enemy, deltaTime, context, volley);
+    case ENEMY_BOSS:
+        return stepEnemy<ENEMY_BOSS>(enemy, deltaTime, context, volley);
+    default:
+        return stepEnemy<ENEMY_GRUNT>(enemy, deltaTime, context, volley);
+    }
+}
+
+inline EnemyShip spawnEnemyArchetype(EnemyArchetypeId archetype, Random& rng) {
+    switch (archetype) {
+    case ENEMY_SCOUT:
+        return EnemyArchetype<ENEMY_SCOUT>::spawn(rng);
+    case ENEMY_TANK:
+        return EnemyArchetype<ENEMY_TANK>::spawn(rng);
+    case ENEMY_KAMIKAZE:
+        return EnemyArchetype<ENEMY_KAMIKAZE>::spawn(rng);
+    case ENEMY_SWARMER:
+        return EnemyArchetype<ENEMY_SWARMER>::spawn(rng);
+    case ENEMY_BOSS:
+        return EnemyArchetype<ENEMY_BOSS>::spawn(rng);
+    default:
+        return EnemyArchetype<ENEMY_GRUNT>::spawn(rng);
+    }
+}
+
+constexpr int ENEMY_THINK_COST[ENEMY_ARCHETYPE_COUNT] = {
+    EnemyArchetype<ENEMY_GRUNT>::THINK_COST,
+    EnemyArchetype<ENEMY_SCOUT>::THINK_COST,
+    EnemyArchetype<ENEMY_TANK>::THINK_COST,
+    EnemyArchetype<ENEMY_KAMIKAZE>::THINK_COST,
+    EnemyArchetype<ENEMY_SWARMER>::THINK_COST,
+    EnemyArchetype<ENEMY_BOSS>::THINK_COST
+};
+
+inline void thinkEnemyDispatched(EnemyShip& enemy, const AiContext& context) {
+    switch (enemy.getArchetype()) {
+    case ENEMY_SCOUT:
+        EnemyArchetype<ENEMY_SCOUT>::think(enemy, context);
+        break;
+    case ENEMY_TANK:
+        EnemyArchetype<ENEMY_TANK>::think(enemy, context);
+        break;
+    case ENEMY_KAMIKAZE:
+        EnemyArchetype<ENEMY_KAMIKAZE>::think(enemy, context);
+        break;
+    case ENEMY_SWARMER:
+        EnemyArchetype<ENEMY_SWARMER>::think(enemy, context);
+        break;
+    case ENEMY_BOSS:
+        EnemyArchetype<ENEMY_BOSS>::think(enemy, context);
+        break;
+    default:
+        EnemyArchetype<ENEMY_GRUNT>::think(enemy, context);
+        break;
+    }
+    enemy.resetThinkTimer();
+}
+
+class AiScheduler {
+private:
+    struct Task {
+        float urgency;
+        uint32_t id;
+        uint32_t index;
+        int cost;
+    };
+
+    vector<Task> due;
+    int budget;
+    int lastCost;
+    size_t lastThinks;
+    size_t lastDeferred;
+    float lastSeconds;
+    uint64_t totalThinks;
+
+public:
+    static const int DEFAULT_BUDGET = 48;
+    static constexpr float MIN_INTERVAL = 1.0f / 120;
+
+    AiScheduler(int budget = DEFAULT_BUDGET) : budget(budget), lastCost(0), lastThinks(0), lastDeferred(0),
+        lastSeconds(0), totalThinks(0) {
+        due.reserve(256);
+    }
+
+    static float thinkInterval(const EnemyShip& enemy, Vector2f playerPosition, float viewTop) {
+        if (enemy.getIsBoss()) return 0;
+        if (enemy.getPosition().y < viewTop) return 0.5f;
+        Vector2f offset = enemy.getPosition() - playerPosition;
+        float distanceSq = offset.x * offset.x + offset.y * offset.y;
+        return distanceSq < 250 * 250 ? 0 : (distanceSq < 500 * 500 ? 0.1f : 0.25f);
+    }
+
+    size_t collect(vector<EnemyShip>& enemies, float deltaTime, Vector2f playerPosition, float viewTop) {
+        due.clear();
+        lastCost = 0;
+        lastThinks = 0;
+        lastDeferred = 0;
+        lastSeconds = 0;
+        for (size_t i = 0; i < enemies.size(); ++i) {
+            EnemyShip& enemy = enemies[i];
+            int cost = ENEMY_THINK_COST[enemy.getArchetype()];
+            if (cost == 0) continue;
+            float waited = enemy.advanceThinkTimer(deltaTime);
+            float interval = thinkInterval(enemy, playerPosition, viewTop);
+            if (waited >= interval) {
+                due.push_back(Task{ waited / max(interval, MIN_INTERVAL), enemy.getId(), static_cast<uint32_t>(i), cost });
+            }
+        }
+        return due.size();
+    }
+
+    void run(vector<EnemyShip>& enemies, const AiContext& context) {
+        auto start = chrono::steady_clock::now();
+        sort(due.begin(), due.end(), [](const Task& a, const Task& b) {
+            return a.urgency != b.urgency ? a.urgency > b.urgency : a.id < b.id;
+        });
+        for (const auto& task : due) {
+            if (lastCost + task.cost > budget) continue;
+            thinkEnemyDispatched(enemies[task.index], context);
+            lastCost += task.cost;
+            lastThinks++;
+        }
+        lastDeferred = due.size() - lastThinks;
+        totalThinks += lastThinks;
+        lastSeconds = chrono::duration<float>(chrono::steady_clock::now() - start).count();
+    }
+
+    int getBudget() const { return budget; }
+    int getLastCost() const { return lastCost; }
+    size_t getLastThinks() const { return lastThinks; }
+    size_t getLastDeferred() const { return lastDeferred; }
+    float getLastSeconds() const { return lastSeconds; }
+    uint64_t getTotalThinks() const { return totalThinks; }
+};
+
+enum StatusEffectType {
+    STATUS_RAPID_FIRE,
+    STATUS_SPREAD_SHOT,
+    STATUS_MISSILES,
+    STATUS_SHIELD,
+    STATUS_SLOW_MOTION,
+    STATUS_EFFECT_COUNT
+};
+
+class StatusEffects {
+private:
+    struct Expiry {
+        double time;
+        uint64_t sequence;
+        StatusEffectType type;
+        bool operator<(const Expiry& other) const {
+            return time != other.time ? time > other.time : sequence > other.sequence;
+        }
+    };
+
+    vector<Expiry> expiries;
+    uint32_t stacks[STATUS_EFFECT_COUNT];
+    double until[STATUS_EFFECT_COUNT];
+    double clock;
+    uint64_t sequence;
+    uint64_t stateHash;
+    size_t lastExpired;
+
+    static uint64_t expiryHash(const Expiry& expiry) {
+        return hashMix(hashCombine(static_cast<uint64_t>(expiry.time * 1e6), (expiry.sequence << 8) | expiry.type));
+    }
+
+public:
+    StatusEffects() {
+        expiries.reserve(64);
+        clear();
+    }
+
+    void clear() {
+        expiries.clear();
+        fill(stacks, stacks + STATUS_EFFECT_COUNT, 0u);
+        fill(until, until + STATUS_EFFECT_COUNT, 0.0);
+        clock = 0;
+        sequence = 0;
+        stateHash = 0;
+        lastExpired = 0;
+    }
+
+    void apply(StatusEffectType type, float duration) {
+        Expiry expiry{ clock + duration, sequence++, type };
+        expiries.push_back(expiry);
+        push_heap(expiries.begin(), expiries.end());
+        stateHash ^= expiryHash(expiry);
+        stacks[type]++;
+        until[type] = max(until[type], expiry.time);
+    }
+
+    size_t advance(float dt) {
+        clock += dt;
+        lastExpired = 0;
+        while (!expiries.empty() && expiries.front().time <= clock) {
+            pop_heap(expiries.begin(), expiries.end());
+            const Expiry& expiry = expiries.back();
+            stateHash ^= expiryHash(expiry);
+            stacks[expiry.type]--;
+            expiries.pop_back();
+            lastExpired++;
+        }
+        return lastExpired;
+    }
+
+    bool isActive(StatusEffectType type) const { return stacks[type] > 0; }
+    float getRemaining(StatusEffectType type) const {
+        return isActive(type) ? static_cast<float>(until[type] - clock) : 0.f;
+    }
+    size_t getActiveCount() const { return expiries.size(); }
+    size_t getLastExpired() const { return lastExpired; }
+    uint64_t getStateHash() const { return hashCombine(stateHash, static_cast<uint64_t>(clock * 1e6)); }
+
+    static const char* typeName(int type) {
+        static const char* names[STATUS_EFFECT_COUNT] = { "rapid fire", "spread", "missiles", "shield", "slow-mo" };
+        return names[type];
+    }
+};
+
+enum PowerUpType {
+    POWER_UP_HEAL,
+    POWER_UP_RAPID_FIRE,
+    POWER_UP_SPREAD_SHOT,
+    POWER_UP_MISSILES,
+    POWER_UP_SHIELD,
+    POWER_UP_SLOW_MOTION,
+    POWER_UP_TYPE_COUNT
+};
+
+struct PowerUpStats {
+    Uint8 fill[3];
+    int statusEffect;
+    float duration;
+};
+
+constexpr PowerUpStats POWER_UP_STATS[POWER_UP_TYPE_COUNT] = {
+    { { 0, 255, 0 }, -1, 0.0f },
+    { { 0, 255, 255 }, STATUS_RAPID_FIRE, 8.0f },
+    { { 255, 255, 0 }, STATUS_SPREAD_SHOT, 10.0f },
+    { { 255, 0, 255 }, STATUS_MISSILES, 10.0f },
+    { { 80, 140, 255 }, STATUS_SHIELD, 6.0f },
+    { { 255, 150, 60 }, STATUS_SLOW_MOTION, 5.0f }
+};
+
+inline Color powerUpColor(int type, float brightness = 1.0f) {
+    const Uint8* fill = POWER_UP_STATS[type].fill;
+    return Color(static_cast<Uint8>(fill[0] * brightness), static_cast<Uint8>(fill[1] * brightness),
+        static_cast<Uint8>(fill[2] * brightness));
+}
+
+class PowerUp {
+private:
+    Vector2f position;
+    Velocity velocity;
+    Color fillColor;
+    int type;
+    float activeTime;
+    float pulseTime;
+    uint32_t id;
+    uint64_t hashValue;
+
+public:
+    PowerUp(Vector2f pos, Random& rng) : PowerUp(pos, rng.nextInt(POWER_UP_TYPE_COUNT)) {}
+
+    PowerUp(Vector2f pos, int type) : position(pos), velocity(0, 100), fillColor(powerUpColor(type)), type(type),
+        activeTime(POWER_UP_STATS[type].duration), pulseTime(0), id(0), hashValue(0) {}
+
+    void update(float deltaTime) {
+        position += Vector2f(velocity.x * deltaTime, velocity.y * deltaTime);
+
+        pulseTime += deltaTime;
+        fillColor = powerUpColor(type, 0.75f + 0.25f * sin(pulseTime * 5));
+    }
+
+    bool isOffScreen(float viewTop) const {
+        return position.y > viewTop + WINDOW_HEIGHT + 50;
+    }
+
+    void applyEffect(PlayerShip& player, StatusEffects& effects) const {
+        if (type == POWER_UP_HEAL) {
+            player.heal(30);
+        }
+        else {
+            effects.apply(static_cast<StatusEffectType>(POWER_UP_STATS[type].statusEffect), activeTime);
+        }
+    }
+
+    FloatRect getBounds() const {
+        return FloatRect(position.x - 17, position.y - 17, 34, 34);
+    }
+
+    uint64_t computeHash() const {
+        return entityStateHash(ENTITY_POWER_UP, id, packFloats(position.x, position.y), static_cast<uint64_t>(type));
+    }
+
+    uint64_t rehash() {
+        uint64_t previous = hashValue;
+        hashValue = computeHash();
+        return previous ^ hashValue;
+    }
+
+    void setId(uint32_t newId) { id = newId; }
+    uint32_t getId() const { return id; }
+    uint64_t getHash() const { return hashValue; }
+
+    const Vector2f& getPosition() const { return position; }
+    const Color& getFillColor() const { return fillColor; }
+    int getType() const { return type; }
+};
+
+struct EffectEvent {
+    Vector2f position;
+    int bursts;
+    EffectEvent(Vector2f position = Vector2f(0, 0), int bursts = 1) : position(position), bursts(bursts) {}
+};
+
+struct Decoration {
+    Vector2f position;
+    float radius;
+    Uint8 shade;
+    Decoration(Vector2f position = Vector2f(0, 0), float radius = 0, Uint8 shade = 0)
+        : position(position), radius(radius), shade(shade) {}
+};
+
+struct WorldChunk {
+    vector<EnemyShip> sleepingEnemies;
+    vector<Decoration> decorations;
+};
+
+enum WorldCommandType {
+    COMMAND_DAMAGE_ENEMY,
+    COMMAND_DAMAGE_PLAYER,
+    COMMAND_SCORE,
+    COMMAND_COLLECT_POWER_UP,
+    COMMAND_SPAWN_POWER_UP,
+    COMMAND_EFFECT,
+    COMMAND_DESPAWN,
+    COMMAND_TYPE_COUNT
+};
+
+enum WorldContainer {
+    CONTAINER_PLAYER_BULLETS,
+    CONTAINER_ENEMY_BULLETS,
+    CONTAINER_MISSILES,
+    CONTAINER_POWER_UPS,
+    CONTAINER_COUNT
+};
+
+struct WorldCommand {
+    uint8_t type;
+    uint8_t container;
+    uint32_t index;
+    int amount;
+    Vector2f position;
+    WorldCommand(WorldCommandType type = COMMAND_EFFECT, uint32_t index = 0, int amount = 0,
+        Vector2f position = Vector2f(0, 0), WorldContainer container = CONTAINER_PLAYER_BULLETS)
+        : type(static_cast<uint8_t>(type)), container(static_cast<uint8_t>(container)), index(index),
+        amount(amount), position(position) {}
+};
+
+class CommandBuffer {
+private:
+    vector<WorldCommand> commands;
+    vector<uint8_t> despawned[CONTAINER_COUNT];
+    uint64_t lastCounts[COMMAND_TYPE_COUNT];
+    uint64_t totalCounts[COMMAND_TYPE_COUNT];
+
+public:
+    CommandBuffer() {
+        commands.reserve(1024);
+        for (auto& flags : despawned) {
+            flags.reserve(1024);
+        }
+        fill(lastCounts, lastCounts + COMMAND_TYPE_COUNT, 0);
+        fill(totalCounts, totalCounts + COMMAND_TYPE_COUNT, 0);
+    }
+
+    void begin(const size_t containerSizes[CONTAINER_COUNT]) {
+        commands.clear();
+        for (int c = 0; c < CONTAINER_COUNT; ++c) {
+            despawned[c].assign(containerSizes[c], 0);
+        }
+    }
+
+    void damageEnemy(uint32_t index, int amount, Vector2f position) {
+        commands.push_back(WorldCommand(COMMAND_DAMAGE_ENEMY, index, amount, position));
+    }
+
+    void damagePlayer(int amount, Vector2f position) {
+        commands.push_back(WorldCommand(COMMAND_DAMAGE_PLAYER, 0, amount, position));
+    }
+
+    void score(int points) {
+        commands.push_back(WorldCommand(COMMAND_SCORE, 0, points));
+    }
+
+    void collectPowerUp(uint32_t index, Vector2f position) {
+        commands.push_back(WorldCommand(COMMAND_COLLECT_POWER_UP, index, 0, position));
+    }
+
+    void spawnPowerUp(Vector2f position) {
+        commands.push_back(WorldCommand(COMMAND_SPAWN_POWER_UP, 0, 0, position));
+    }
+
+    void effect(Vector2f position, int bursts) {
+        commands.push_back(WorldCommand(COMMAND_EFFECT, 0, bursts, position));
+    }
+
+    bool despawn(WorldContainer container, uint32_t index) {
+        if (index >= despawned[container].size() || despawned[container][index]) return false;
+        despawned[container][index] = 1;
+        commands.push_back(WorldCommand(COMMAND_DESPAWN, index, 0, Vector2f(0, 0), container));
+        return true;
+    }
+
+    bool isDespawned(WorldContainer container, size_t index) const {
+        return index < despawned[container].size() && despawned[container][index];
+    }
+
+    size_t size() const { return commands.size(); }
+    const WorldCommand& operator[](size_t index) const { return commands[index]; }
+
+    void finish() {
+        fill(lastCounts, lastCounts + COMMAND_TYPE_COUNT, 0);
+        for (const auto& command : commands) {
+            lastCounts[command.type]++;
+        }
+        for (int type = 0; type < COMMAND_TYPE_COUNT; ++type) {
+            totalCounts[type] += lastCounts[type];
+        }
+        commands.clear();
+    }
+
+    uint64_t getLastCount(int type) const { return lastCounts[type]; }
+    uint64_t getTotalCount(int type) const { return totalCounts[type]; }
+
+    static const char* typeName(int type) {
+        static const char* names[COMMAND_TYPE_COUNT] = { "damage", "hurt", "score", "collect", "spawn", "effect", "despawn" };
+        return names[type];
+    }
+};
+
+class ScriptFramePool {
+private:
+    static const size_t SIZE_CLASS_COUNT = 5;
+    static const size_t SMALLEST_BLOCK = 128;
+    static const size_t BLOCKS_PER_SLAB = 32;
+
+    vector<void*> freeBlocks[SIZE_CLASS_COUNT];
+    vector<unique_ptr<char[]>> slabs;
+    size_t liveBytes;
+    size_t reservedBytes;
+
+    static int sizeClass(size_t size) {
+        size_t block = SMALLEST_BLOCK;
+        for (int c = 0; c < static_cast<int>(SIZE_CLASS_COUNT); ++c, block *= 2) {
+            if (size <= block) return c;
+        }
+        return -1;
+    }
+
+public:
+    ScriptFramePool() : liveBytes(0), reservedBytes(0) {}
+
+    ScriptFramePool(const ScriptFramePool&) = delete;
+    ScriptFramePool& operator=(const ScriptFramePool&) = delete;
+
+    void* allocate(size_t size) {
+        liveBytes += size;
+        int c = sizeClass(size);
+        if (c < 0) return ::operator new(size);
+
+        vector<void*>& blocks = freeBlocks[c];
+        if (blocks.empty()) {
+            size_t blockSize = SMALLEST_BLOCK << c;
+            slabs.push_back(unique_ptr<char[]>(new char[blockSize * BLOCKS_PER_SLAB]));
+            reservedBytes += blockSize * BLOCKS_PER_SLAB;
+            blocks.reserve(blocks.size() + BLOCKS_PER_SLAB);
+            for (size_t i = 0; i < BLOCKS_PER_SLAB; ++i) {
+                blocks.push_back(slabs.back().get() + (BLOCKS_PER_SLAB - 1 - i) * blockSize);
+            }
+        }
+        void* block = blocks.back();
+        blocks.pop_back();
+        return block;
+    }
+
+    void deallocate(void* block, size_t size) {
+        liveBytes -= size;
+        int c = sizeClass(size);
+        if (c < 0) {
+            ::operator delete(block);
+            return;
+        }
+        freeBlocks[c].push_back(block);
+    }
+
+    size_t getLiveBytes() const { return liveBytes; }
+    size_t getReservedBytes() const { return reservedBytes; }
+};
+
+class EncounterScript {
+public:
+    struct promise_type {
+        static const size_t HEADER_SIZE = 16;
+
+        template <typename Owner, typename... Args>
+        static void* operator new(size_t size, Owner& owner, Args&...) {
+            ScriptFramePool& pool = owner.getScriptScheduler().getFramePool();
+            char* block = static_cast<char*>(pool.allocate(size + HEADER_SIZE));
+            *reinterpret_cast<ScriptFramePool**>(block) = &pool;
+            return block + HEADER_SIZE;
+        }
+
+        static void operator delete(void* frame, size_t size) {
+            char* block = static_cast<char*>(frame) - HEADER_SIZE;
+            (*reinterpret_cast<ScriptFramePool**>(block))->deallocate(block, size + HEADER_SIZE);
+        }
+
+        EncounterScript get_return_object() {
+            return EncounterScript(coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        suspend_always initial_suspend() noexcept { return {}; }
+        suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { terminate(); }
+    };
+
+    explicit EncounterScript(coroutine_handle<promise_type> handle = nullptr) : handle(handle) {}
+
+    EncounterScript(EncounterScript&& other) noexcept : handle(other.handle) {
+        other.handle = nullptr;
+    }
+
+    EncounterScript(const EncounterScript&) = delete;
+    EncounterScript& operator=(const EncounterScript&) = delete;
+
+    ~EncounterScript() {
+        if (handle) handle.destroy();
+    }
+
+    coroutine_handle<> release() {
+        coroutine_handle<> released = handle;
+        handle = nullptr;
+        return released;
+    }
+
+private:
+    coroutine_handle<promise_type> handle;
+};
+
+enum ScriptEvent {
+    SCRIPT_EVENT_WAVE_CLEARED,
+    SCRIPT_EVENT_COUNT
+};
+
+class ScriptScheduler {
+private:
+    struct Timer {
+        double wakeTime;
+        uint64_t sequence;
+        coroutine_handle<> handle;
+        bool operator<(const Timer& other) const {
+            return wakeTime != other.wakeTime ? wakeTime > other.wakeTime : sequence > other.sequence;
+        }
+    };
+
+    ScriptFramePool framePool;
+    vector<Timer> timers;
+    vector<coroutine_handle<>> eventWaiters[SCRIPT_EVENT_COUNT];
+    vector<coroutine_handle<>> waking;
+    double time;
+    uint64_t sequence;
+    uint64_t stateHash;
+    uint64_t resumeCount;
+    size_t liveScripts;
+
+    void resume(coroutine_handle<> handle) {
+        stateHash = hashCombine(stateHash, hashCombine(++resumeCount, static_cast<uint64_t>(time * 1e6)));
+        handle.resume();
+        if (handle.done()) {
+            handle.destroy();
+            liveScripts--;
+        }
+    }
+
+public:
+    struct Delay {
+        ScriptScheduler& scheduler;
+        double seconds;
+        bool await_ready() const { return false; }
+        void await_suspend(coroutine_handle<> handle) {
+            scheduler.timers.push_back(Timer{ scheduler.time + seconds, scheduler.sequence++, handle });
+            push_heap(scheduler.timers.begin(), scheduler.timers.end());
+        }
+        void await_resume() const {}
+    };
+
+    struct EventWait {
+        ScriptScheduler& scheduler;
+        ScriptEvent event;
+        bool await_ready() const { return false; }
+        void await_suspend(coroutine_handle<> handle) {
+            scheduler.eventWaiters[event].push_back(handle);
+        }
+        void await_resume() const {}
+    };
+
+    ScriptScheduler() : time(0), sequence(0), stateHash(0), resumeCount(0), liveScripts(0) {
+        timers.reserve(256);
+        waking.reserve(256);
+        for (auto& waiters : eventWaiters) {
+            waiters.reserve(64);
+        }
+    }
+
+    ~ScriptScheduler() {
+        clear();
+    }
+
+    ScriptScheduler(const ScriptScheduler&) = delete;
+    ScriptScheduler& operator=(const ScriptScheduler&) = delete;
+
+    ScriptScheduler& getScriptScheduler() { return *this; }
+    ScriptFramePool& getFramePool() { return framePool; }
+
+    void clear() {
+        for (auto& timer : timers) {
+            timer.handle.destroy();
+        }
+        timers.clear();
+        for (auto& waiters : eventWaiters) {
+            for (auto handle : waiters) {
+                handle.destroy();
+            }
+            waiters.clear();
+        }
+        time = 0;
+        sequence = 0;
+        stateHash = 0;
+        resumeCount = 0;
+        liveScripts = 0;
+    }
+
+    void start(EncounterScript script) {
+        liveScripts++;
+        resume(script.release());
+    }
+
+    Delay delay(double seconds) { return Delay{ *this, seconds }; }
+    Delay nextTick() { return Delay{ *this, 0 }; }
+    EventWait event(ScriptEvent event) { return EventWait{ *this, event }; }
+
+    void waitFor(ScriptEvent event, coroutine_handle<> handle) {
+        eventWaiters[event].push_back(handle);
+    }
+
+    void advance(double dt) {
+        time += dt;
+        uint64_t sequenceLimit = sequence;
+        while (!timers.empty() && timers.front().wakeTime <= time && timers.front().sequence < sequenceLimit) {
+            pop_heap(timers.begin(), timers.end());
+            coroutine_handle<> handle = timers.back().handle;
+            timers.pop_back();
+            resume(handle);
+        }
+    }
+
+    void raise(ScriptEvent event) {
+        if (eventWaiters[event].empty()) return;
+        waking.swap(eventWaiters[event]);
+        for (auto handle : waking) {
+            resume(handle);
+        }
+        waking.clear();
+    }
+
+    bool hasWaiters(ScriptEvent event) const { return !eventWaiters[event].empty(); }
+    double getTime() const { return time; }
+    uint64_t getStateHash() const { return stateHash; }
+    uint64_t getResumeCount() const { return resumeCount; }
+    size_t getLiveScripts() const { return liveScripts; }
+    size_t getSuspendedOnTimers() const { return timers.size(); }
+};
+
+enum SpectatorGlobal {
+    SPECTATOR_SEED,
+    SPECTATOR_STATE,
+    SPECTATOR_CAMERA_TOP,
+    SPECTATOR_WAVE,
+    SPECTATOR_SCORE,
+    SPECTATOR_HEALTH,
+    SPECTATOR_INVINCIBLE,
+    SPECTATOR_COOLDOWN,
+    SPECTATOR_PLAYER_X,
+    SPECTATOR_PLAYER_Y,
+    SPECTATOR_STATUS_REMAINING,
+    SPECTATOR_GLOBAL_COUNT = SPECTATOR_STATUS_REMAINING + STATUS_EFFECT_COUNT
+};
+
+const int SPECTATOR_FIELD_COUNT = 4;
+const float SPECTATOR_POSITION_SCALE = 8.f;
+const int SPECTATOR_COOLDOWN_SCALE = 255;
+const float SPECTATOR_STATUS_SCALE = 10.f;
+
+struct SpectatorEntity {
+    uint64_t key;
+    int32_t fields[SPECTATOR_FIELD_COUNT];
+
+    EntityKind getKind() const { return static_cast<EntityKind>(key >> 32); }
+    uint32_t getId() const { return static_cast<uint32_t>(key); }
+    Vector2f getPosition() const {
+        return Vector2f(fields[0] / SPECTATOR_POSITION_SCALE, fields[1] / SPECTATOR_POSITION_SCALE);
+    }
+};
+
+struct SpectatorSnapshot {
+    uint32_t sequence;
+    int32_t globals[SPECTATOR_GLOBAL_COUNT];
+    vector<SpectatorEntity> entities;
+    vector<EffectEvent> effects;
+
+    SpectatorSnapshot() : sequence(0) {
+        fill(globals, globals + SPECTATOR_GLOBAL_COUNT, 0);
+        entities.reserve(256);
+        effects.reserve(16);
+    }
+
+    static int32_t quantize(float value) {
+        return static_cast<int32_t>(lround(value * SPECTATOR_POSITION_SCALE));
+    }
+
+    void addEntity(EntityKind kind, uint32_t id, Vector2f position, int32_t a = 0, int32_t b = 0) {
+        SpectatorEntity entity;
+        entity.key = (static_cast<uint64_t>(kind) << 32) | id;
+        entity.fields[0] = quantize(position.x);
+        entity.fields[1] = quantize(position.y);
+        entity.fields[2] = a;
+        entity.fields[3] = b;
+        entities.push_back(entity);
+    }
+};
+
+class GameWorld {
+private:
+    Random rng;
+    PlayerShip player;
+
+    vector<WorldChunk> chunks;
+    int nextChunk;
+    float cameraTop;
+
+    vector<EnemyShip> enemies;
+    size_t enemyArchetypeEnd[ENEMY_ARCHETYPE_COUNT];
+    size_t waveEnemiesAlive;
+    int waveNumber;
+
+    vector<Bullet> playerBullets;
+    vector<Bullet> enemyBullets;
+    vector<Bullet> playerMissiles;
+
+    SpatialGrid enemyGrid;
+    SpatialGrid swarmGrid;
+    vector<Vector2f> queryPoints;
+    vector<int32_t> queryIndices;
+    vector<uint32_t> neighborIndices;
+    vector<uint32_t> neighborCounts;
+    vector<Velocity> swarmSteering;
+    CircleBatch enemyCircles;
+    vector<int> pendingEnemyHealth;
+    CircleNarrowphase narrowphase;
+    SpatialGrid playerBulletGrid;
+    AiScheduler aiScheduler;
+
+    vector<PowerUp> powerUps;
+    float powerUpSpawnTimer;
+    StatusEffects statusEffects;
+
+    vector<EffectEvent> effects;
+    bool effectsEnabled;
+
+    CommandBuffer commands;
+    ScriptScheduler scripts;
+
+    uint32_t levelSeed;
+    bool levelGenerated;
+    uint32_t nextEntityId;
+    uint64_t spawnedEnemyCount;
+    uint64_t killedEnemyCount;
+    uint64_t entityHash;
+    uint64_t tickCount;
+    bool stateHashing;
+
+public:
+    GameWorld() : chunks(LEVEL_CHUNKS), nextChunk(LEVEL_CHUNKS - 1), cameraTop(LEVEL_HEIGHT - WINDOW_HEIGHT),
+        waveEnemiesAlive(0), waveNumber(1), powerUpSpawnTimer(10.0f), effectsEnabled(true), levelSeed(0), levelGenerated(false), nextEntityId(1),
+        spawnedEnemyCount(0),
+        killedEnemyCount(0), entityHash(0), tickCount(0),
+        stateHashing(true) {
+        fill(enemyArchetypeEnd, enemyArchetypeEnd + ENEMY_ARCHETYPE_COUNT, 0);
+        enemies.reserve(256);
+        playerBullets.reserve(256);
+        enemyBullets.reserve(1024);
+        playerMissiles.reserve(256);
+        enemyGrid.reserve(256);
+        swarmGrid.reserve(256);
+        enemyCircles.reserve(256);
+        pendingEnemyHealth.reserve(256);
+        playerBulletGrid.reserve(256);
+        queryPoints.reserve(256);
+        queryIndices.reserve(256);
+        neighborIndices.reserve(256 * EnemyArchetype<ENEMY_SWARMER>::NEIGHBORS);
+        neighborCounts.reserve(256);
+        swarmSteering.reserve(256);
+        powerUps.reserve(64);
+        effects.reserve(256);
+    }
+
+    void reset(uint32_t seed) {
+        rng.setSeed(seed);
+        cameraTop = LEVEL_HEIGHT - WINDOW_HEIGHT;
+        nextChunk = LEVEL_CHUNKS - 1;
+        generateLevel(seed);
+        levelSeed = seed;
+        levelGenerated = true;
+
+        player = PlayerShip(cameraTop);
+        enemies.clear();
+        waveEnemiesAlive = 0;
+        fill(enemyArchetypeEnd, enemyArchetypeEnd + ENEMY_ARCHETYPE_COUNT, 0);
+        playerBullets.clear();
+        enemyBullets.clear();
+        playerMissiles.clear();
+        powerUps.clear();
+        effects.clear();
+        statusEffects.clear();
+
+        waveNumber = 1;
+        powerUpSpawnTimer = 10.0f;
+
+        nextEntityId = 1;
+        tickCount = 0;
+        entityHash = 0;
+        rehashEntity(player);
+
+        scripts.clear();
+        scripts.start(waveScript());
+    }
+
+    void setEffectsEnabled(bool enabled) {
+        effectsEnabled = enabled;
+    }
+
+    void setStateHashing(bool enabled) {
+        stateHashing = enabled;
+        entityHash = 0;
+        if (!enabled) return;
+        rehashEntity(player);
+        for (auto& enemy : enemies) rehashEntity(enemy);
+        for (auto& bullet : playerBullets) rehashEntity(bullet, ENTITY_PLAYER_BULLET);
+        for (auto& bullet : enemyBullets) rehashEntity(bullet, ENTITY_ENEMY_BULLET);
+        for (auto& missile : playerMissiles) rehashEntity(missile, ENTITY_MISSILE);
+        for (auto& powerUp : powerUps) rehashEntity(powerUp);
+        entityHash = recomputeEntityHash();
+    }
+
+    void clearEffects() {
+        effects.clear();
+    }
+
+    void step(float dt, const PlayerInput& input) {
+        statusEffects.advance(dt);
+        player.setMaxShootCooldown(statusEffects.isActive(STATUS_RAPID_FIRE) ? RAPID_FIRE_COOLDOWN : BASE_SHOOT_COOLDOWN);
+        player.setShielded(statusEffects.isActive(STATUS_SHIELD));
+        float enemyDt = statusEffects.isActive(STATUS_SLOW_MOTION) ? dt * SLOW_MOTION_SCALE : dt;
+
+        if (input.fire && player.canShoot()) {
+            addBullet(playerBullets, player.createBullet(), ENTITY_PLAYER_BULLET);
+            if (statusEffects.isActive(STATUS_SPREAD_SHOT)) {
+                addBullet(playerBullets, player.createBullet(-SPREAD_SHOT_SPEED), ENTITY_PLAYER_BULLET);
+                addBullet(playerBullets, player.createBullet(SPREAD_SHOT_SPEED), ENTITY_PLAYER_BULLET);
+            }
+            if (statusEffects.isActive(STATUS_MISSILES)) {
+                addBullet(playerMissiles, player.createMissile(-1), ENTITY_MISSILE);
+                addBullet(playerMissiles, player.createMissile(1), ENTITY_MISSILE);
+            }
+            player.shoot();
+        }
+
+        float scrolled = min(SCROLL_SPEED * dt, cameraTop);
+        cameraTop -= scrolled;
+        player.update(dt, input, cameraTop, scrolled);
+        streamChunks();
+
+        scripts.advance(dt);
+
+        powerUpSpawnTimer += dt;
+        if (powerUpSpawnTimer >= 15.0f) {
+            Vector2f spawnPos(rng.nextInt(WINDOW_WIDTH - 100) + 50, cameraTop - 50);
+            addPowerUp(PowerUp(spawnPos, rng));
+            powerUpSpawnTimer = 0;
+        }
+
+        thinkEnemies(enemyDt);
+        flockSwarm(enemyDt);
+        updateEnemies(enemyDt, scrolled);
+        if (waveEnemiesAlive == 0) {
+            scripts.raise(SCRIPT_EVENT_WAVE_CLEARED);
+        }
+        enemyGrid.rebuild(enemies.size(), [this](size_t i) { return enemies[i].getPosition(); });
+
+        size_t containerSizes[CONTAINER_COUNT] = {
+            playerBullets.size(), enemyBullets.size(), playerMissiles.size(), powerUps.size()
+        };
+        commands.begin(containerSizes);
+
+        for (size_t i = 0; i < playerBullets.size(); ++i) {
+            playerBullets[i].position += playerBullets[i].velocity * dt;
+            rehashEntity(playerBullets[i], ENTITY_PLAYER_BULLET);
+            if (playerBullets[i].position.y < cameraTop - 10) {
+                commands.despawn(CONTAINER_PLAYER_BULLETS, i);
+            }
+        }
+
+        for (size_t i = 0; i < enemyBullets.size(); ++i) {
+            enemyBullets[i].position += enemyBullets[i].velocity * enemyDt;
+            rehashEntity(enemyBullets[i], ENTITY_ENEMY_BULLET);
+            if (enemyBullets[i].position.y > cameraTop + WINDOW_HEIGHT + 10) {
+                commands.despawn(CONTAINER_ENEMY_BULLETS, i);
+            }
+        }
+
+        updateMissiles(dt);
+
+        for (size_t i = 0; i < powerUps.size(); ++i) {
+            powerUps[i].update(dt);
+            rehashEntity(powerUps[i]);
+            if (powerUps[i].isOffScreen(cameraTop)) {
+                commands.despawn(CONTAINER_POWER_UPS, i);
+            }
+        }
+
+        checkCollisions();
+        flushCommands();
+
+        rehashEntity(player);
+        tickCount++;
+    }
+
+    uint64_t getStateHash() const {
+        return combineStateHash(entityHash);
+    }
+
+    uint64_t recomputeStateHash() const {
+        return combineStateHash(recomputeEntityHash());
+    }
+
+    void captureSnapshot(SpectatorSnapshot& snapshot) const {
+        int32_t* globals = snapshot.globals;
+        globals[SPECTATOR_SEED] = static_cast<int32_t>(levelSeed);
+        globals[SPECTATOR_CAMERA_TOP] = SpectatorSnapshot::quantize(cameraTop);
+        globals[SPECTATOR_WAVE] = waveNumber;
+        globals[SPECTATOR_SCORE] = player.getScore();
+        globals[SPECTATOR_HEALTH] = player.getHealth();
+        globals[SPECTATOR_INVINCIBLE] = player.getIsInvincible();
+        globals[SPECTATOR_COOLDOWN] = static_cast<int32_t>(lround(max(0.f, player.getShootCooldown()) /
+            player.getMaxShootCooldown() * SPECTATOR_COOLDOWN_SCALE));
+        globals[SPECTATOR_PLAYER_X] = SpectatorSnapshot::quantize(player.getPosition().x);
+        globals[SPECTATOR_PLAYER_Y] = SpectatorSnapshot::quantize(player.getPosition().y);
+        for (int type = 0; type < STATUS_EFFECT_COUNT; ++type) {
+            float remaining = statusEffects.getRemaining(static_cast<StatusEffectType>(type));
+            globals[SPECTATOR_STATUS_REMAINING + type] = static_cast<int32_t>(ceil(remaining * SPECTATOR_STATUS_SCALE));
+        }
+
+        snapshot.entities.clear();
+        for (const auto& enemy : enemies) {
+            snapshot.addEntity(ENTITY_ENEMY, enemy.getId(), enemy.getPosition(), enemy.getArchetype(), enemy.getHealth());
+        }
+        for (const auto& bullet : playerBullets) snapshot.addEntity(ENTITY_PLAYER_BULLET, bullet.id, bullet.position);
+        for (const auto& bullet : enemyBullets) snapshot.addEntity(ENTITY_ENEMY_BULLET, bullet.id, bullet.position);
+        for (const auto& missile : playerMissiles) snapshot.addEntity(ENTITY_MISSILE, missile.id, missile.position);
+        for (const auto& powerUp : powerUps) {
+            snapshot.addEntity(ENTITY_POWER_UP, powerUp.getId(), powerUp.getPosition(), powerUp.getType());
+        }
+        sort(snapshot.entities.begin(), snapshot.entities.end(),
+            [](const SpectatorEntity& a, const SpectatorEntity& b) { return a.key < b.key; });
+
+        snapshot.effects.assign(effects.begin(), effects.end());
+    }
+
+    void applySnapshot(const SpectatorSnapshot& snapshot) {
+        const int32_t* globals = snapshot.globals;
+        uint32_t seed = static_cast<uint32_t>(globals[SPECTATOR_SEED]);
+        if (!levelGenerated || seed != levelSeed) {
+            reset(seed);
+        }
+
+        cameraTop = globals[SPECTATOR_CAMERA_TOP] / SPECTATOR_POSITION_SCALE;
+        waveNumber = globals[SPECTATOR_WAVE];
+        player.restore(Vector2f(globals[SPECTATOR_PLAYER_X] / SPECTATOR_POSITION_SCALE,
+            globals[SPECTATOR_PLAYER_Y] / SPECTATOR_POSITION_SCALE), globals[SPECTATOR_HEALTH], globals[SPECTATOR_SCORE],
+            globals[SPECTATOR_COOLDOWN] * player.getMaxShootCooldown() / SPECTATOR_COOLDOWN_SCALE,
+            globals[SPECTATOR_INVINCIBLE] != 0);
+        statusEffects.clear();
+        for (int type = 0; type < STATUS_EFFECT_COUNT; ++type) {
+            if (globals[SPECTATOR_STATUS_REMAINING + type] > 0) {
+                statusEffects.apply(static_cast<StatusEffectType>(type),
+                    globals[SPECTATOR_STATUS_REMAINING + type] / SPECTATOR_STATUS_SCALE);
+            }
+        }
+        player.setShielded(statusEffects.isActive(STATUS_SHIELD));
+
+        enemies.clear();
+        playerBullets.clear();
+        enemyBullets.clear();
+        playerMissiles.clear();
+        powerUps.clear();
+        auto firstEnemy = partition_point(snapshot.entities.begin(), snapshot.entities.end(),
+            [](const SpectatorEntity& entity) { return entity.getKind() < ENTITY_ENEMY; });
+        auto lastEnemy = partition_point(firstEnemy, snapshot.entities.end(),
+            [](const SpectatorEntity& entity) { return entity.getKind() == ENTITY_ENEMY; });
+        for (int archetype = 0; archetype < ENEMY_ARCHETYPE_COUNT; ++archetype) {
+            for (auto entity = firstEnemy; entity != lastEnemy; ++entity) {
+                if (entity->fields[2] != archetype) continue;
+                EnemyShip enemy(static_cast<EnemyArchetypeId>(archetype), entity->getPosition(), Velocity());
+                enemy.takeDamage(enemy.getMaxHealth() - entity->fields[3]);
+                enemy.setId(entity->getId());
+                enemies.push_back(enemy);
+            }
+            enemyArchetypeEnd[archetype] = enemies.size();
+        }
+        for (const auto& entity : snapshot.entities) {
+            switch (entity.getKind()) {
+            case ENTITY_PLAYER_BULLET:
+                playerBullets.push_back(Bullet(entity.getPosition()));
+                playerBullets.back().id = entity.getId();
+                break;
+            case ENTITY_ENEMY_BULLET:
+                enemyBullets.push_back(Bullet(entity.getPosition()));
+                enemyBullets.back().id = entity.getId();
+                break;
+            case ENTITY_MISSILE:
+                playerMissiles.push_back(Bullet(entity.getPosition()));
+                playerMissiles.back().id = entity.getId();
+                break;
+            case ENTITY_POWER_UP:
+                if (entity.fields[2] >= 0 && entity.fields[2] < POWER_UP_TYPE_COUNT) {
+                    powerUps.push_back(PowerUp(entity.getPosition(), entity.fields[2]));
+                    powerUps.back().setId(entity.getId());
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    uint64_t getTickCount() const { return tickCount; }
+    uint64_t getSpawnedEnemyCount() const { return spawnedEnemyCount; }
+    uint64_t getKilledEnemyCount() const { return killedEnemyCount; }
+    bool isGameOver() const { return !player.getIsAlive(); }
+    const PlayerShip& getPlayer() const { return player; }
+    const vector<EnemyShip>& getEnemies() const { return enemies; }
+    const vector<Bullet>& getPlayerBullets() const { return playerBullets; }
+    const vector<Bullet>& getEnemyBullets() const { return enemyBullets; }
+    const vector<Bullet>& getPlayerMissiles() const { return playerMissiles; }
+    const vector<PowerUp>& getPowerUps() const { return powerUps; }
+    const StatusEffects& getStatusEffects() const { return statusEffects; }
+    const vector<EffectEvent>& getEffects() const { return effects; }
+    const CommandBuffer& getCommands() const { return commands; }
+    SimdLevel getNarrowphaseLevel() const { return narrowphase.getLevel(); }
+    const AiScheduler& getAiScheduler() const { return aiScheduler; }
+    ScriptScheduler& getScriptScheduler() { return scripts; }
+    const ScriptScheduler& getScripts() const { return scripts; }
+    int getWaveNumber() const { return waveNumber; }
+    float getCameraTop() const { return cameraTop; }
+    const vector<WorldChunk>& getChunks() const { return chunks; }
+    int getActiveChunkCount() const { return LEVEL_CHUNKS - 1 - nextChunk; }
+
+private:
+    template <typename Entity>
+    void rehashEntity(Entity& entity) {
+        if (stateHashing) entityHash ^= entity.rehash();
+    }
+
+    void rehashEntity(Bullet& bullet, EntityKind kind) {
+        if (stateHashing) entityHash ^= bullet.rehash(kind);
+    }
+
+    template <typename Entity>
+    void unhashEntity(const Entity& entity) {
+        if (stateHashing) entityHash ^= entity.getHash();
+    }
+
+    uint64_t recomputeEntityHash() const {
+        uint64_t hash = player.computeHash();
+        for (const auto& enemy : enemies) hash ^= enemy.computeHash();
+        for (const auto& bullet : playerBullets) hash ^= bullet.computeHash(ENTITY_PLAYER_BULLET);
+        for (const auto& bullet : enemyBullets) hash ^= bullet.computeHash(ENTITY_ENEMY_BULLET);
+        for (const auto& missile : playerMissiles) hash ^= missile.computeHash(ENTITY_MISSILE);
+        for (const auto& powerUp : powerUps) hash ^= powerUp.computeHash();
+        return hash;
+    }
+
+    uint64_t combineStateHash(uint64_t entities) const {
+        uint64_t hash = hashCombine(entities, (tickCount << 32) | rng.getState());
+        hash = hashCombine(hash, packFloats(static_cast<float>(scripts.getTime()), powerUpSpawnTimer));
+        hash = hashCombine(hash, packInts(waveNumber, waveEnemiesAlive));
+        hash = hashCombine(hash, packFloats(cameraTop, static_cast<float>(nextChunk)));
+        hash = hashCombine(hash, statusEffects.getStateHash());
+        return hashCombine(hash, scripts.getStateHash());
+    }
+
+    void addEffect(Vector2f position, int bursts) {
+        if (effectsEnabled) {
+            effects.push_back(EffectEvent(position, bursts));
+        }
+    }
+
+    void addEnemy(const EnemyShip& enemy) {
+        int archetype = enemy.getArchetype();
+        auto inserted = enemies.insert(enemies.begin() + enemyArchetypeEnd[archetype], enemy);
+        for (int i = archetype; i < ENEMY_ARCHETYPE_COUNT; ++i) {
+            enemyArchetypeEnd[i]++;
+        }
+        inserted->setId(nextEntityId++);
+        rehashEntity(*inserted);
+        spawnedEnemyCount++;
+    }
+
+    void generateLevel(uint32_t seed) {
+        Random levelRng(seed ^ 0x5EED1E7Eu);
+        int startChunk = static_cast<int>(cameraTop) / CHUNK_HEIGHT;
+
+        for (int c = 0; c < LEVEL_CHUNKS; ++c) {
+            WorldChunk& chunk = chunks[c];
+            chunk.sleepingEnemies.clear();
+            chunk.decorations.clear();
+            float chunkTop = static_cast<float>(c * CHUNK_HEIGHT);
+
+            int decorationCount = levelRng.nextInt(4);
+            for (int i = 0; i < decorationCount; ++i) {
+                chunk.decorations.push_back(Decoration(
+                    Vector2f(levelRng.nextInt(WINDOW_WIDTH), chunkTop + levelRng.nextInt(CHUNK_HEIGHT)),
+                    static_cast<float>(levelRng.nextInt(30) + 6), static_cast<Uint8>(levelRng.nextInt(50) + 40)));
+            }
+
+            if (c >= startChunk - 1 || levelRng.nextInt(100) >= 45) continue;
+
+            int formation = levelRng.nextInt(3);
+            float row = chunkTop + levelRng.nextInt(CHUNK_HEIGHT);
+            if (formation == 2) {
+                float center = static_cast<float>(levelRng.nextInt(WINDOW_WIDTH - 300) + 150);
+                int swarmSize = levelRng.nextInt(10) + 10;
+                for (int i = 0; i < swarmSize; ++i) {
+                    EnemyShip enemy = spawnEnemyArchetype(ENEMY_SWARMER, levelRng);
+                    enemy.placeInLevel(Vector2f(center + levelRng.nextInt(160) - 80, row + levelRng.nextInt(100) - 50));
+                    chunk.sleepingEnemies.push_back(enemy);
+                }
+                continue;
+            }
+
+            EnemyArchetypeId archetype = formation ? ENEMY_GRUNT : ENEMY_SCOUT;
+            int formationSize = levelRng.nextInt(3) + 2;
+            float left = static_cast<float>(levelRng.nextInt(WINDOW_WIDTH - 100 - formationSize * 60) + 50);
+            for (int i = 0; i < formationSize; ++i) {
+                EnemyShip enemy = spawnEnemyArchetype(archetype, levelRng);
+                enemy.placeInLevel(Vector2f(left + i * 60, row));
+                chunk.sleepingEnemies.push_back(enemy);
+            }
+        }
+    }
+
+    void streamChunks() {
+        while (nextChunk >= 0 && (nextChunk + 1) * CHUNK_HEIGHT > cameraTop - CHUNK_HEIGHT) {
+            for (const auto& enemy : chunks[nextChunk].sleepingEnemies) {
+                addEnemy(enemy);
+            }
+            nextChunk--;
+        }
+    }
+
+    void thinkEnemies(float dt) {
+        if (aiScheduler.collect(enemies, dt, player.getPosition(), cameraTop) == 0) return;
+
+        playerBulletGrid.rebuild(playerBullets.size(), [this](size_t i) { return playerBullets[i].position; });
+        const Velocity& playerVelocity = player.getVelocity();
+        float scrollSpeed = cameraTop > 0 ? SCROLL_SPEED : 0;
+        AiContext context(player.getPosition(), Vector2f(playerVelocity.x, playerVelocity.y - scrollSpeed), cameraTop,
+            playerBullets, playerBulletGrid);
+        aiScheduler.run(enemies, context);
+    }
+
+    void flockSwarm(float dt) {
+        const size_t neighbors = EnemyArchetype<ENEMY_SWARMER>::NEIGHBORS;
+        size_t first = enemyArchetypeEnd[ENEMY_SWARMER - 1];
+        size_t count = enemyArchetypeEnd[ENEMY_SWARMER] - first;
+        if (count == 0) return;
+
+        const EnemyShip* swarm = enemies.data() + first;
+        swarmGrid.rebuild(count, [swarm](size_t i) { return swarm[i].getPosition(); });
+
+        queryPoints.resize(count);
+        queryIndices.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            queryPoints[i] = swarm[i].getPosition();
+            queryIndices[i] = static_cast<int32_t>(i);
+        }
+        neighborIndices.resize(count * neighbors);
+        neighborCounts.resize(count);
+        swarmGrid.kNearestBatch(queryPoints.data(), count, neighbors, 80, neighborIndices.data(),
+            neighborCounts.data(), queryIndices.data());
+
+        swarmSteering.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            swarmSteering[i] = EnemyArchetype<ENEMY_SWARMER>::flock(swarm[i], swarm, &neighborIndices[i * neighbors],
+                neighborCounts[i], player.getPosition(), dt);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            enemies[first + i].setVelocity(swarmSteering[i]);
+        }
+    }
+
+    void updateMissiles(float dt) {
+        const float speed = 600;
+        size_t count = playerMissiles.size();
+        queryPoints.resize(count);
+        queryIndices.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            queryPoints[i] = playerMissiles[i].position;
+        }
+        enemyGrid.nearestBatch(queryPoints.data(), count, WINDOW_HEIGHT, queryIndices.data());
+
+        for (size_t i = 0; i < count; ++i) {
+            Bullet& missile = playerMissiles[i];
+            if (queryIndices[i] >= 0 && enemies[queryIndices[i]].isAlive()) {
+                Vector2f offset = enemies[queryIndices[i]].getPosition() - missile.position;
+                float distance = max(1.0f, sqrt(offset.x * offset.x + offset.y * offset.y));
+                missile.velocity += (offset * (speed / distance) - missile.velocity) * min(1.0f, 5 * dt);
+            }
+            float currentSpeed = max(1.0f, sqrt(missile.velocity.x * missile.velocity.x + missile.velocity.y * missile.velocity.y));
+            missile.velocity *= speed / currentSpeed;
+            missile.position += missile.velocity * dt;
+            rehashEntity(missile, ENTITY_MISSILE);
+
+            if (missile.position.y < cameraTop - 10 || missile.position.y > cameraTop + WINDOW_HEIGHT + 10 ||
+                missile.position.x < -10 || missile.position.x > WINDOW_WIDTH + 10) {
+                commands.despawn(CONTAINER_MISSILES, i);
+            }
+        }
+    }
+
+    void flushCommands() {
+        bool enemiesKilled = false;
+        for (size_t i = 0; i < commands.size(); ++i) {
+            const WorldCommand command = commands[i];
+            switch (command.type) {
+            case COMMAND_DAMAGE_ENEMY: {
+                EnemyShip& enemy = enemies[command.index];
+                bool wasAlive = enemy.isAlive();
+                enemy.takeDamage(command.amount);
+                rehashEntity(enemy);
+                if (wasAlive && !enemy.isAlive()) {
+                    enemiesKilled = true;
+                    killedEnemyCount++;
+                    commands.score(enemy.getPoints());
+                    commands.spawnPowerUp(enemy.getPosition());
+                    commands.effect(enemy.getPosition(), 3);
+                }
+                break;
+            }
+            case COMMAND_DAMAGE_PLAYER:
+                player.takeDamage(command.amount);
+                break;
+            case COMMAND_SCORE:
+                player.addScore(command.amount);
+                break;
+            case COMMAND_COLLECT_POWER_UP:
+                powerUps[command.index].applyEffect(player, statusEffects);
+                break;
+            case COMMAND_SPAWN_POWER_UP:
+                spawnPowerUp(command.position);
+                break;
+            case COMMAND_EFFECT:
+                addEffect(command.position, command.amount);
+                break;
+            }
+        }
+
+        compact(playerBullets, CONTAINER_PLAYER_BULLETS);
+        compact(enemyBullets, CONTAINER_ENEMY_BULLETS);
+        compact(playerMissiles, CONTAINER_MISSILES);
+        compact(powerUps, CONTAINER_POWER_UPS);
+        if (enemiesKilled) {
+            compactEnemies();
+        }
+        commands.finish();
+    }
+
+    void compactEnemies() {
+        size_t begin = 0;
+        size_t kept = 0;
+        for (int archetype = 0; archetype < ENEMY_ARCHETYPE_COUNT; ++archetype) {
+            size_t end = enemyArchetypeEnd[archetype];
+            for (size_t i = begin; i < end; ++i) {
+                if (!enemies[i].isAlive()) {
+                    unhashEntity(enemies[i]);
+                    if (!enemies[i].isLevelPlaced()) {
+                        waveEnemiesAlive--;
+                    }
+                    continue;
+                }
+                if (kept != i) {
+                    enemies[kept] = enemies[i];
+                }
+                kept++;
+            }
+            begin = end;
+            enemyArchetypeEnd[archetype] = kept;
+        }
+        enemies.erase(enemies.begin() + kept, enemies.end());
+    }
+
+    template <typename Entity>
+    void compact(vector<Entity>& entities, WorldContainer container) {
+        size_t kept = 0;
+        for (size_t i = 0; i < entities.size(); ++i) {
+            if (commands.isDespawned(container, i)) {
+                unhashEntity(entities[i]);
+                continue;
+            }
+            if (kept != i) {
+                entities[kept] = entities[i];
+            }
+            kept++;
+        }
+        entities.erase(entities.begin() + kept, entities.end());
+    }
+
+    void updateEnemies(float dt, float scrolled) {
+        size_t begin = 0;
+        size_t kept = 0;
+        EnemyContext context(player.getPosition(), cameraTop, scrolled);
+        waveEnemiesAlive = 0;
+        updateEnemyArchetype<ENEMY_GRUNT>(dt, context, begin, kept);
+        updateEnemyArchetype<ENEMY_SCOUT>(dt, context, begin, kept);
+        updateEnemyArchetype<ENEMY_TANK>(dt, context, begin, kept);
+        updateEnemyArchetype<ENEMY_KAMIKAZE>(dt, context, begin, kept);
+        updateEnemyArchetype<ENEMY_SWARMER>(dt, context, begin, kept);
+        updateEnemyArchetype<ENEMY_BOSS>(dt, context, begin, kept);
+        enemies.erase(enemies.begin() + kept, enemies.end());
+    }
+
+    template <int Archetype>
+    void updateEnemyArchetype(float dt, const EnemyContext& context, size_t& begin, size_t& kept) {
+        Bullet volley[MAX_ENEMY_VOLLEY];
+        size_t end = enemyArchetypeEnd[Archetype];
+
+        for (size_t i = begin; i < end; ++i) {
+            EnemyShip& enemy = enemies[i];
+            int shots = stepEnemy<Archetype>(enemy, dt, context, volley);
+            for (int shot = 0; shot < shots; ++shot) {
+                addBullet(enemyBullets, volley[shot], ENTITY_ENEMY_BULLET);
+            }
+            rehashEntity(enemy);
+
+            if (enemy.isOffScreen(cameraTop) || !enemy.isAlive()) {
+                unhashEntity(enemy);
+                continue;
+            }
+            if (kept != i) {
+                enemies[kept] = enemy;
+            }
+            if (!enemy.isLevelPlaced()) {
+                waveEnemiesAlive++;
+            }
+            kept++;
+        }
+
+        begin = end;
+        enemyArchetypeEnd[Archetype] = kept;
+    }
+
+    void addBullet(vector<Bullet>& bullets, const Bullet& bullet, EntityKind kind) {
+        bullets.push_back(bullet);
+        bullets.back().id = nextEntityId++;
+        rehashEntity(bullets.back(), kind);
+    }
+
+    void addPowerUp(const PowerUp& powerUp) {
+        powerUps.push_back(powerUp);
+        powerUps.back().setId(nextEntityId++);
+        rehashEntity(powerUps.back());
+    }
+
+    struct WaveCleared {
+        GameWorld& world;
+        bool await_ready() const { return world.waveEnemiesAlive == 0; }
+        void await_suspend(coroutine_handle<> handle) { world.scripts.waitFor(SCRIPT_EVENT_WAVE_CLEARED, handle); }
+        void await_resume() const {}
+    };
+
+    EncounterScript waveScript() {
+        while (true) {
+            int enemyCount = 3 + 2 * waveNumber;
+            float interval = max(0.3f, 1.05f - waveNumber * 0.05f);
+            for (int i = 0; i < enemyCount; ++i) {
+                co_await scripts.delay(interval);
+                spawnWaveArchetype(pickEnemyArchetype());
+            }
+            co_await WaveCleared{ *this };
+
+            if (waveNumber % 3 == 0) {
+                co_await scripts.delay(interval);
+                addWaveEnemy(spawnEnemyArchetype(ENEMY_BOSS, rng));
+                co_await WaveCleared{ *this };
+            }
+            waveNumber++;
+        }
+    }
+
+    void spawnWaveArchetype(EnemyArchetypeId archetype) {
+        if (archetype == ENEMY_SWARMER) {
+            addWaveSwarm();
+        }
+        else {
+            addWaveEnemy(spawnEnemyArchetype(archetype, rng));
+        }
+    }
+
+    void addWaveSwarm() {
+        EnemyShip leader = spawnEnemyArchetype(ENEMY_SWARMER, rng);
+        int members = rng.nextInt(6) + 6;
+        for (int i = 0; i < members; ++i) {
+            EnemyShip member = leader;
+            member.translate(Vector2f(rng.nextInt(120) - 60, -rng.nextInt(80)));
+            addWaveEnemy(member);
+        }
+    }
+
+    void addWaveEnemy(EnemyShip enemy) {
+        enemy.translate(Vector2f(0, cameraTop));
+        addEnemy(enemy);
+        waveEnemiesAlive++;
+    }
+
+    EnemyArchetypeId pickEnemyArchetype() {
+        int roll = rng.nextInt(100);
+        if (waveNumber >= 2 && roll < 20) return ENEMY_SCOUT;
+        if (waveNumber >= 3 && roll < 35) return ENEMY_KAMIKAZE;
+        if (waveNumber >= 4 && roll < 50) return ENEMY_TANK;
+        if (waveNumber >= 5 && roll < 62) return ENEMY_SWARMER;
+        return ENEMY_GRUNT;
+    }
+
+    void spawnPowerUp(Vector2f position) {
+        if (rng.nextInt(100) < 10) {
+            addPowerUp(PowerUp(position, rng));
+        }
+    }
+
+    void queueEnemyDamage(size_t index, int amount, Vector2f position) {
+        commands.damageEnemy(static_cast<uint32_t>(index), amount, position);
+        pendingEnemyHealth[index] -= amount;
+        if (pendingEnemyHealth[index] <= 0) {
+            enemyCircles.remove(index);
+        }
+    }
+
+    void checkCollisions() {
+        enemyCircles.clear();
+        pendingEnemyHealth.clear();
+        for (const auto& enemy : enemies) {
+            pendingEnemyHealth.push_back(enemy.getHealth());
+            if (enemy.isAlive()) {
+                enemyCircles.add(enemy.getPosition(), enemy.getRadius());
+            } else {
+                enemyCircles.addEmpty();
+            }
+        }
+        enemyCircles.finish();
+
+        for (size_t i = 0; i < playerBullets.size(); ++i) {
+            if (commands.isDespawned(CONTAINER_PLAYER_BULLETS, i)) continue;
+
+            Vector2f bulletPos = playerBullets[i].position;
+            int32_t hit = narrowphase.firstOverlap(enemyCircles, bulletPos, playerBullets[i].radius);
+            if (hit >= 0) {
+                queueEnemyDamage(hit, 25, bulletPos);
+                commands.effect(bulletPos, 1);
+                commands.despawn(CONTAINER_PLAYER_BULLETS, i);
+            }
+        }
+
+        for (size_t i = 0; i < playerMissiles.size(); ++i) {
+            if (commands.isDespawned(CONTAINER_MISSILES, i)) continue;
+
+            const Bullet& missile = playerMissiles[i];
+            int32_t hit = -1;
+            enemyGrid.forEachInRadius(missile.position, missile.radius + ENEMY_STATS[ENEMY_BOSS].radius,
+                [&](uint32_t j, float distanceSq) {
+                    float reach = enemies[j].getRadius() + missile.radius;
+                    if (hit < 0 && pendingEnemyHealth[j] > 0 && distanceSq < reach * reach) {
+                        hit = static_cast<int32_t>(j);
+                    }
+                });
+
+            if (hit >= 0) {
+                queueEnemyDamage(hit, 40, missile.position);
+                commands.effect(missile.position, 1);
+                commands.despawn(CONTAINER_MISSILES, i);
+            }
+        }
+
+        FloatRect playerBounds = player.getShape().getGlobalBounds();
+        for (size_t i = 0; i < enemyBullets.size(); ++i) {
+            if (commands.isDespawned(CONTAINER_ENEMY_BULLETS, i)) continue;
+
+            if (playerBounds.intersects(enemyBullets[i].getBounds())) {
+                commands.damagePlayer(10, player.getPosition());
+                commands.despawn(CONTAINER_ENEMY_BULLETS, i);
+                commands.effect(player.getPosition(), 1);
+            }
+        }
+
+        if (player.getIsAlive()) {
+            for (size_t i = 0; i < enemies.size(); ++i) {
+                if (pendingEnemyHealth[i] > 0 && playerBounds.intersects(enemies[i].getBounds())) {
+                    commands.damagePlayer(enemies[i].getDamage(), player.getPosition());
+                    queueEnemyDamage(i, 100, enemies[i].getPosition());
+                    commands.effect(enemies[i].getPosition(), 5);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < powerUps.size(); ++i) {
+            if (commands.isDespawned(CONTAINER_POWER_UPS, i)) continue;
+
+            if (playerBounds.intersects(powerUps[i].getBounds())) {
+                commands.collectPowerUp(i, powerUps[i].getPosition());
+                commands.despawn(CONTAINER_POWER_UPS, i);
+                commands.effect(player.getPosition(), 1);
+            }
+        }
+    }
+};
+
+struct ReplayFrame {
+    float dt;
+    PlayerInput input;
+    uint64_t stateHash;
+    ReplayFrame(float dt = 0, const PlayerInput& input = PlayerInput(), uint64_t stateHash = 0)
+        : dt(dt), input(input), stateHash(stateHash) {}
+};
+
+struct ReplayResult {
+    bool diverged;
+    size_t tick;
+    uint64_t expectedHash;
+    uint64_t actualHash;
+    ReplayResult() : diverged(false), tick(0), expectedHash(0), actualHash(0) {}
+};
+
+class Replay {
+private:
+    static const uint32_t MAGIC = 0x50525353;
+    static const uint32_t VERSION = 1;
+
+    uint32_t seed;
+    vector<ReplayFrame> frames;
+
+    template <typename T>
+    static void writeValue(ostream& out, const T& value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    static bool readValue(istream& in, T& value) {
+        return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+    }
+
+public:
+    Replay() : seed(0) {}
+
+    void begin(uint32_t seed, size_t reservedFrames) {
+        this->seed = seed;
+        frames.clear();
+        frames.reserve(reservedFrames);
+    }
+
+    void record(float dt, const PlayerInput& input, uint64_t stateHash) {
+        frames.push_back(ReplayFrame(dt, input, stateHash));
+    }
+
+    bool save(const string& path) const {
+        ofstream out(path, ios::binary);
+        if (!out) return false;
+
+        writeValue(out, static_cast<uint32_t>(MAGIC));
+        writeValue(out, static_cast<uint32_t>(VERSION));
+        writeValue(out, seed);
+        writeValue(out, static_cast<uint64_t>(frames.size()));
+        for (const auto& frame : frames) {
+            writeValue(out, frame.dt);
+            writeValue(out, frame.input.moveX);
+            writeValue(out, frame.input.moveY);
+            writeValue(out, static_cast<uint8_t>(frame.input.fire));
+            writeValue(out, frame.stateHash);
+        }
+        return static_cast<bool>(out);
+    }
+
+    bool load(const string& path) {
+        ifstream in(path, ios::binary);
+        uint32_t magic = 0, version = 0;
+        uint64_t frameCount = 0;
+        if (!readValue(in, magic) || !readValue(in, version) || magic != MAGIC || version != VERSION ||
+            !readValue(in, seed) || !readValue(in, frameCount)) {
+            return false;
+        }
+
+        frames.clear();
+        for (uint64_t i = 0; i < frameCount; ++i) {
+            ReplayFrame frame;
+            uint8_t fire = 0;
+            if (!readValue(in, frame.dt) || !readValue(in, frame.input.moveX) ||
+                !readValue(in, frame.input.moveY) || !readValue(in, fire) || !readValue(in, frame.stateHash)) {
+                return false;
+            }
+            frame.input.fire = fire != 0;
+            frames.push_back(frame);
+        }
+        return true;
+    }
+
+    ReplayResult verify(GameWorld& world) const {
+        ReplayResult result;
+        world.reset(seed);
+        for (size_t tick = 0; tick < frames.size(); ++tick) {
+            world.step(frames[tick].dt, frames[tick].input);
+            world.clearEffects();
+            uint64_t hash = world.getStateHash();
+            if (hash != frames[tick].stateHash) {
+                result.diverged = true;
+                result.tick = tick;
+                result.expectedHash = frames[tick].stateHash;
+                result.actualHash = hash;
+                return result;
+            }
+        }
+        result.tick = frames.size();
+        result.actualHash = world.getStateHash();
+        return result;
+    }
+
+    uint32_t getSeed() const { return seed; }
+    size_t getFrameCount() const { return frames.size(); }
+    bool isEmpty() const { return frames.empty(); }
+};
+
+enum ObservationMode {
+    OBSERVE_FEATURES,
+    OBSERVE_GRID
+};
+
+class BatchedEnvironment {
+public:
+    static const int ACTION_COUNT = 18;
+    static const int MAX_OBSERVED_ENEMIES = 16;
+    static const int MAX_OBSERVED_ENEMY_BULLETS = 32;
+    static const int MAX_OBSERVED_PLAYER_BULLETS = 16;
+    static const int FEATURE_SIZE = 4 + MAX_OBSERVED_ENEMIES * 5 +
+        MAX_OBSERVED_ENEMY_BULLETS * 3 + MAX_OBSERVED_PLAYER_BULLETS * 3;
+    static const int GRID_CELL_SIZE = 25;
+    static const int GRID_COLUMNS = WINDOW_WIDTH / GRID_CELL_SIZE;
+    static const int GRID_ROWS = WINDOW_HEIGHT / GRID_CELL_SIZE;
+    static const int GRID_CHANNELS = 4;
+
+private:
+    vector<GameWorld> worlds;
+    vector<int> lastScores;
+    vector<int> lastHealth;
+    vector<int> episodeSteps;
+    vector<uint32_t> episodeCounts;
+    ObservationMode mode;
+    uint32_t baseSeed;
+    float stepDelta;
+    int maxEpisodeSteps;
+    WorkerPool pool;
+
+    struct StepJob {
+        BatchedEnvironment* env;
+        const int* actions;
+        float* observations;
+        float* rewards;
+        Uint8* dones;
+        int* scores;
+
+        void operator()(size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                env->stepOne(i, actions, observations, rewards, dones, scores);
+            }
+        }
+    };
+
+    struct ResetJob {
+        BatchedEnvironment* env;
+        float* observations;
+
+        void operator()(size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                env->resetOne(i);
+                env->writeObservation(i, observations + i * env->getObservationSize());
+            }
+        }
+    };
+
+    static PlayerInput decodeAction(int action) {
+        if (action < 0 || action >= ACTION_COUNT) action = 0;
+        float moveX = static_cast<float>(action % 3) - 1;
+        float moveY = static_cast<float>((action / 3) % 3) - 1;
+        return PlayerInput(moveX, moveY, action >= 9);
+    }
+
+    void resetOne(size_t index) {
+        uint32_t seed = baseSeed + static_cast<uint32_t>(index) * 2654435761u +
+            episodeCounts[index] * 40503u;
+        worlds[index].reset(seed);
+        episodeCounts[index]++;
+        episodeSteps[index] = 0;
+        lastScores[index] = 0;
+        lastHealth[index] = worlds[index].getPlayer().getHealth();
+    }
+
+    void stepOne(size_t index, const int* actions, float* observations,
+        float* rewards, Uint8* dones, int* scores) {
+        GameWorld& world = worlds[index];
+        world.step(stepDelta, decodeAction(actions[index]));
+        episodeSteps[index]++;
+
+        const PlayerShip& player = world.getPlayer();
+        int score = player.getScore();
+        float reward = (score - lastScores[index]) * 0.01f -
+            (lastHealth[index] - player.getHealth()) * 0.01f;
+        bool done = world.isGameOver() || episodeSteps[index] >= maxEpisodeSteps;
+        if (world.isGameOver()) reward -= 1.0f;
+
+        rewards[index] = reward;
+        dones[index] = done ? 1 : 0;
+        scores[index] = score;
+
+        if (done) {
+            resetOne(index);
+        }
+        else {
+            lastScores[index] = score;
+            lastHealth[index] = player.getHealth();
+        }
+
+        writeObservation(index, observations + index * getObservationSize());
+    }
+
+    static float* writeBullets(float* out, const vector<Bullet>& bullets, size_t maxCount, float viewTop) {
+        size_t count = min(bullets.size(), maxCount);
+        for (size_t i = 0; i < count; ++i) {
+            *out++ = 1.0f;
+            *out++ = bullets[i].position.x / WINDOW_WIDTH;
+            *out++ = (bullets[i].position.y - viewTop) / WINDOW_HEIGHT;
+        }
+        fill(out, out + (maxCount - count) * 3, 0.0f);
+        return out + (maxCount - count) * 3;
+    }
+
+    static void markCell(float* channel, Vector2f position, float viewTop) {
+        position.y -= viewTop;
+        int column = static_cast<int>(position.x) / GRID_CELL_SIZE;
+        int row = static_cast<int>(position.y) / GRID_CELL_SIZE;
+        if (position.x >= 0 && position.y >= 0 && column < GRID_COLUMNS && row < GRID_ROWS) {
+            channel[row * GRID_COLUMNS + column] = 1.0f;
+        }
+    }
+
+    void writeObservation(size_t index, float* out) const {
+        const GameWorld& world = worlds[index];
+        const PlayerShip& player = world.getPlayer();
+        float viewTop = world.getCameraTop();
+
+        if (mode == OBSERVE_GRID) {
+            const size_t channelSize = GRID_COLUMNS * GRID_ROWS;
+            fill(out, out + channelSize * GRID_CHANNELS, 0.0f);
+            markCell(out, player.getPosition(), viewTop);
+            for (const auto& enemy : world.getEnemies()) {
+                markCell(out + channelSize, enemy.getPosition(), viewTop);
+            }
+            for (const auto& bullet : world.getEnemyBullets()) {
+                markCell(out + channelSize * 2, bullet.position, viewTop);
+            }
+            for (const auto& bullet : world.getPlayerBullets()) {
+                markCell(out + channelSize * 3, bullet.position, viewTop);
+            }
+            return;
+        }
+
+        *out++ = player.getPosition().x / WINDOW_WIDTH;
+        *out++ = (player.getPosition().y - viewTop) / WINDOW_HEIGHT;
+        *out++ = player.getHealth() / 100.f;
+        *out++ = player.getShootCooldown() / player.getMaxShootCooldown();
+
+        const vector<EnemyShip>& enemies = world.getEnemies();
+        size_t enemyCount = min(enemies.size(), static_cast<size_t>(MAX_OBSERVED_ENEMIES));
+        for (size_t i = 0; i < enemyCount; ++i) {
+            *out++ = 1.0f;
+            *out++ = enemies[i].getPosition().x / WINDOW_WIDTH;
+            *out++ = (enemies[i].getPosition().y - viewTop) / WINDOW_HEIGHT;
+            *out++ = static_cast<float>(enemies[i].getHealth()) / enemies[i].getMaxHealth();
+            *out++ = enemies[i].getIsBoss() ? 1.0f : 0.0f;
+        }
+        fill(out, out + (MAX_OBSERVED_ENEMIES - enemyCount) * 5, 0.0f);
+        out += (MAX_OBSERVED_ENEMIES - enemyCount) * 5;
+
+        out = writeBullets(out, world.getEnemyBullets(), MAX_OBSERVED_ENEMY_BULLETS, viewTop);
+        writeBullets(out, world.getPlayerBullets(), MAX_OBSERVED_PLAYER_BULLETS, viewTop);
+    }
+
+public:
+    BatchedEnvironment(size_t envCount, ObservationMode mode = OBSERVE_FEATURES,
+        unsigned threadCount = thread::hardware_concurrency(), uint32_t seed = 1,
+        float stepDelta = 1.0f / 60.f, int maxEpisodeSteps = 60 * 60 * 5)
+        : worlds(envCount), lastScores(envCount, 0), lastHealth(envCount, 0),
+        episodeSteps(envCount, 0), episodeCounts(envCount, 0), mode(mode),
+        baseSeed(seed), stepDelta(stepDelta), maxEpisodeSteps(maxEpisodeSteps),
+        pool(max(1u, min(threadCount, static_cast<unsigned>(envCount)))) {
+        for (auto& world : worlds) {
+            world.setEffectsEnabled(false);
+            world.setStateHashing(false);
+        }
+    }
+
+    size_t getEnvCount() const { return worlds.size(); }
+    unsigned getThreadCount() const { return pool.getThreadCount(); }
+
+    size_t getObservationSize() const {
+        if (mode == OBSERVE_GRID) {
+            return GRID_COLUMNS * GRID_ROWS * GRID_CHANNELS;
+        }
+        return FEATURE_SIZE;
+    }
+
+    void reset(float* observations) {
+        ResetJob job = { this, observations };
+        pool.parallelFor(worlds.size(), job);
+    }
+
+    void step(const int* actions, float* observations, float* rewards, Uint8* dones, int* scores) {
+        StepJob job = { this, actions, observations, rewards, dones, scores };
+        pool.parallelFor(worlds.size(), job);
+    }
+};
+
+template <typename T>
+class BoundedQueue {
+private:
+    vector<T> items;
+    size_t head;
+    size_t count;
+    bool closed;
+    mutable mutex queueMutex;
+    condition_variable notEmpty;
+    condition_variable notFull;
+
+public:
+    explicit BoundedQueue(size_t capacity) : items(capacity), head(0), count(0), closed(false) {
+    }
+
+    bool tryPush(const T& item) {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            if (closed || count == items.size()) return false;
+            items[(head + count) % items.size()] = item;
+            count++;
+        }
+        notEmpty.notify_one();
+        return true;
+    }
+
+    bool push(const T& item) {
+        {
+            unique_lock<mutex> lock(queueMutex);
+            notFull.wait(lock, [&] { return closed || count < items.size(); });
+            if (closed) return false;
+            items[(head + count) % items.size()] = item;
+            count++;
+        }
+        notEmpty.notify_one();
+        return true;
+    }
+
+    bool tryPop(T& item) {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            if (count == 0) return false;
+            item = items[head];
+            head = (head + 1) % items.size();
+            count--;
+        }
+        notFull.notify_one();
+        return true;
+    }
+
+    bool pop(T& item) {
+        {
+            unique_lock<mutex> lock(queueMutex);
+            notEmpty.wait(lock, [&] { return closed || count > 0; });
+            if (count == 0) return false;
+            item = items[head];
+            head = (head + 1) % items.size();
+            count--;
+        }
+        notFull.notify_one();
+        return true;
+    }
+
+    void close() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            closed = true;
+        }
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+    size_t size() const {
+        lock_guard<mutex> lock(queueMutex);
+        return count;
+    }
+};
+
+enum CaptureFormat {
+    CAPTURE_PNG,
+    CAPTURE_RAW
+};
+
+class FrameCapture {
+private:
+    struct Frame {
+        vector<Uint8> pixels;
+        uint64_t index;
+    };
+
+    unsigned width;
+    unsigned height;
+    string directory;
+    CaptureFormat format;
+    bool lossless;
+
+    vector<Frame> frames;
+    BoundedQueue<Frame*> freeFrames;
+    BoundedQueue<Frame*> pendingFrames;
+    vector<thread> workers;
+
+    uint64_t nextIndex;
+    uint64_t droppedFrames;
+    uint64_t stalledFrames;
+    float lastWaitSeconds;
+    float maxWaitSeconds;
+    double totalWaitSeconds;
+    size_t maxQueueDepth;
+    atomic<uint64_t> writtenFrames;
+    atomic<uint64_t> failedFrames;
+    atomic<uint64_t> encodeMicroseconds;
+
+    void workerLoop() {
+        AllocationTracker::setPhase(PHASE_INSTRUMENTATION);
+
+        vector<Uint8> flipped(static_cast<size_t>(width) * height * 4);
+        fstream rawFile;
+        if (format == CAPTURE_RAW) {
+            rawFile.open(directory + "/capture.rgba", ios::in | ios::out | ios::binary);
+        }
+
+        Frame* frame = nullptr;
+        while (pendingFrames.pop(frame)) {
+            double start = monotonicSeconds();
+
+            size_t rowBytes = static_cast<size_t>(width) * 4;
+            for (unsigned y = 0; y < height; ++y) {
+                copy(frame->pixels.begin() + (height - 1 - y) * rowBytes,
+                    frame->pixels.begin() + (height - y) * rowBytes,
+                    flipped.begin() + y * rowBytes);
+            }
+
+            bool written;
+            if (format == CAPTURE_PNG) {
+                char name[32];
+                snprintf(name, sizeof(name), "/frame_%06llu.png", static_cast<unsigned long long>(frame->index));
+                Image image;
+                image.create(width, height, flipped.data());
+                written = image.saveToFile(directory + name);
+            }
+            else {
+                rawFile.seekp(static_cast<streamoff>(frame->index * flipped.size()));
+                rawFile.write(reinterpret_cast<const char*>(flipped.data()), flipped.size());
+                written = rawFile.good();
+            }
+
+            (written ? writtenFrames : failedFrames).fetch_add(1);
+            encodeMicroseconds.fetch_add(static_cast<uint64_t>((monotonicSeconds() - start) * 1e6));
+            freeFrames.push(frame);
+        }
+    }
+
+public:
+    FrameCapture(unsigned width, unsigned height, const string& directory, CaptureFormat format,
+        bool lossless, unsigned workerCount = 2, size_t queueCapacity = 8)
+        : width(width), height(height), directory(directory), format(format), lossless(lossless),
+        frames(queueCapacity), freeFrames(queueCapacity), pendingFrames(queueCapacity),
+        nextIndex(0), droppedFrames(0), stalledFrames(0), lastWaitSeconds(0), maxWaitSeconds(0), totalWaitSeconds(0),
+        maxQueueDepth(0), writtenFrames(0), failedFrames(0),
+        encodeMicroseconds(0) {
+        for (auto& frame : frames) {
+            frame.pixels.resize(static_cast<size_t>(width) * height * 4);
+            freeFrames.push(&frame);
+        }
+
+        if (format == CAPTURE_RAW) {
+            ofstream(directory + "/capture.rgba", ios::binary | ios::trunc);
+            ofstream info(directory + "/capture.txt");
+            info << "format rgba8\nwidth " << width << "\nheight " << height << "\n";
+        }
+
+        for (unsigned i = 0; i < max(workerCount, 1u); ++i) {
+            workers.emplace_back(&FrameCapture::workerLoop, this);
+        }
+    }
+
+    ~FrameCapture() {
+        finish();
+    }
+
+    void finish() {
+        pendingFrames.close();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+    }
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    void captureFrom(RenderTexture& texture) {
+        AllocationPhaseScope phase(PHASE_INSTRUMENTATION);
+
+        Frame* frame = nullptr;
+        lastWaitSeconds = 0;
+        if (!freeFrames.tryPop(frame)) {
+            if (!lossless) {
+                droppedFrames++;
+                return;
+            }
+            double start = monotonicSeconds();
+            freeFrames.pop(frame);
+            lastWaitSeconds = static_cast<float>(monotonicSeconds() - start);
+            maxWaitSeconds = max(maxWaitSeconds, lastWaitSeconds);
+            totalWaitSeconds += lastWaitSeconds;
+            stalledFrames++;
+        }
+
+        texture.setActive(true);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, frame->pixels.data());
+        texture.setActive(false);
+
+        frame->index = nextIndex++;
+        pendingFrames.tryPush(frame);
+        maxQueueDepth = max(maxQueueDepth, pendingFrames.size());
+    }
+
+    uint64_t getCapturedFrames() const { return nextIndex; }
+    uint64_t getDroppedFrames() const { return droppedFrames; }
+    uint64_t getStalledFrames() const { return stalledFrames; }
+    float getLastWaitSeconds() const { return lastWaitSeconds; }
+    float getMaxWaitSeconds() const { return maxWaitSeconds; }
+    double getTotalWaitSeconds() const { return totalWaitSeconds; }
+    uint64_t getWrittenFrames() const { return writtenFrames; }
+    uint64_t getFailedFrames() const { return failedFrames; }
+    size_t getQueueDepth() const { return pendingFrames.size(); }
+    size_t getMaxQueueDepth() const { return maxQueueDepth; }
+
+    float getAverageEncodeTime() const {
+        uint64_t frames = writtenFrames + failedFrames;
+        return frames ? encodeMicroseconds / 1e6f / frames : 0;
+    }
+
+    void printStats(ostream& out) const {
+        out << "Capture: " << nextIndex << " captured, " << writtenFrames << " written, "
+            << failedFrames << " failed, " << droppedFrames << " dropped, " << stalledFrames << " stalled ("
+            << totalWaitSeconds * 1000 << " ms total, max " << maxWaitSeconds * 1000 << " ms), max queue depth "
+            << maxQueueDepth << ", average encode " << getAverageEncodeTime() * 1000 << " ms" << endl;
+    }
+};
+
+struct LaunchOptions {
+    unsigned targetFrameRate;
+    unsigned refreshRate;
+    bool strictAllocations;
+    unsigned seed;
+    string captureDirectory;
+    CaptureFormat captureFormat;
+    bool captureLossless;
+    string replayPath;
+    float flightSeconds;
+    float flightSpikeMs;
+    string flightDirectory;
+    unsigned short broadcastPort;
+    unsigned short spectatePort;
+    LaunchOptions() : targetFrameRate(60), refreshRate(0), strictAllocations(false), seed(0),
+        captureFormat(CAPTURE_PNG), captureLossless(false), flightSeconds(10), flightSpikeMs(50),
+        flightDirectory("."), broadcastPort(0), spectatePort(0) {}
+};
+
+enum FlightDumpReason {
+    FLIGHT_HOTKEY,
+    FLIGHT_SPIKE,
+    FLIGHT_CRASH,
+    FLIGHT_REASON_COUNT
+};
+
+struct FlightRecord {
+    double time;
+    uint32_t frame;
+    float interval;
+    float workTime;
+    float tickTime;
+    float renderTime;
+    uint32_t allocations;
+    uint16_t enemies;
+    uint16_t playerBullets;
+    uint16_t enemyBullets;
+    uint16_t missiles;
+    uint16_t powerUps;
+    uint16_t particles;
+    uint16_t spawned;
+    uint16_t killed;
+    uint16_t playerHits;
+    int8_t moveX;
+    int8_t moveY;
+    uint8_t fire;
+    uint8_t state;
+    uint8_t quality;
+    uint8_t reserved;
+};
+
+class FlightRecorder {
+private:
+    static const uint32_t MAGIC = 0x43455246;
+    static const uint32_t VERSION = 1;
+    static const size_t PATH_CAPACITY = 512;
+
+    vector<FlightRecord> records;
+    size_t head;
+    size_t count;
+    float spikeThreshold;
+    string directory;
+    char crashPath[PATH_CAPACITY];
+
+    vector<FlightRecord> pending;
+    size_t pendingCount;
+    FlightDumpReason pendingReason;
+    bool dumpQueued;
+    bool stopping;
+    unsigned dumpCount;
+    uint64_t skippedDumps;
+    mutex dumpMutex;
+    condition_variable dumpReady;
+    thread writer;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t recordSize;
+        uint32_t count;
+        uint32_t reason;
+        float spikeThreshold;
+    };
+
+    static int openFile(const char* path) {
+#ifdef _MSC_VER
+        return _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        return ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    }
+
+    static bool writeBytes(int file, const void* data, size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+#ifdef _MSC_VER
+            int written = _write(file, bytes, static_cast<unsigned>(min<size_t>(size, INT_MAX)));
+#else
+            ssize_t written = ::write(file, bytes, size);
+#endif
+            if (written <= 0) return false;
+            bytes += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    static bool closeFile(int file) {
+#ifdef _MSC_VER
+        return _close(file) == 0;
+#else
+        return ::close(file) == 0;
+#endif
+    }
+
+    bool writeDump(const char* path, FlightDumpReason reason, const FlightRecord* first, size_t firstCount,
+        const FlightRecord* second, size_t secondCount) const {
+        int file = openFile(path);
+        if (file < 0) return false;
+
+        Header header = { MAGIC, VERSION, static_cast<uint32_t>(sizeof(FlightRecord)),
+            static_cast<uint32_t>(firstCount + secondCount), static_cast<uint32_t>(reason), spikeThreshold };
+        bool written = writeBytes(file, &header, sizeof(header)) &&
+            writeBytes(file, first, firstCount * sizeof(FlightRecord)) &&
+            writeBytes(file, second, secondCount * sizeof(FlightRecord));
+        return closeFile(file) && written;
+    }
+
+    size_t oldestIndex() const {
+        return (head + records.size() - count) % records.size();
+    }
+
+    void writerLoop() {
+        AllocationTracker::setPhase(PHASE_INSTRUMENTATION);
+        unique_lock<mutex> lock(dumpMutex);
+        while (true) {
+            dumpReady.wait(lock, [this] { return dumpQueued || stopping; });
+            if (!dumpQueued) return;
+            FlightDumpReason reason = pendingReason;
+            size_t frames = pendingCount;
+            lock.unlock();
+
+            ostringstream name;
+            name << "flight_" << ++dumpCount << "_" << reasonName(reason) << ".bin";
+            string path = (filesystem::path(directory) / name.str()).string();
+            if (writeDump(path.c_str(), reason, pending.data(), frames, nullptr, 0)) {
+                cout << "Flight recorder: wrote " << frames << " frames to " << path << " (" << reasonName(reason) << ")\n";
+            }
+            else {
+                cout << "Flight recorder: cannot write " << path << "\n";
+            }
+
+            lock.lock();
+            dumpQueued = false;
+        }
+    }
+
+public:
+    static const unsigned RECORDS_PER_SECOND = 240;
+
+    FlightRecorder(float seconds = 10, float spikeThreshold = 0.05f, const string& directory = ".")
+        : records(max<size_t>(1, static_cast<size_t>(seconds * RECORDS_PER_SECOND))), head(0), count(0),
+        spikeThreshold(spikeThreshold), directory(directory), pending(records.size()), pendingCount(0),
+        pendingReason(FLIGHT_HOTKEY), dumpQueued(false), stopping(false), dumpCount(0), skippedDumps(0) {
+        string path = (filesystem::path(directory) / "flight_crash.bin").string();
+        snprintf(crashPath, PATH_CAPACITY, "%s", path.c_str());
+        writer = thread(&FlightRecorder::writerLoop, this);
+    }
+
+    ~FlightRecorder() {
+        {
+            lock_guard<mutex> lock(dumpMutex);
+            stopping = true;
+        }
+        dumpReady.notify_one();
+        writer.join();
+    }
+
+    FlightRecord& next() {
+        FlightRecord& record = records[head];
+        head = (head + 1) % records.size();
+        count = min(count + 1, records.size());
+        return record;
+    }
+
+    bool isSpike(float interval) const {
+        return spikeThreshold > 0 && interval > spikeThreshold;
+    }
+
+    bool dump(FlightDumpReason reason) {
+        lock_guard<mutex> lock(dumpMutex);
+        if (dumpQueued) {
+            skippedDumps++;
+            return false;
+        }
+        size_t oldest = oldestIndex();
+        size_t firstPart = min(count, records.size() - oldest);
+        copy(records.begin() + oldest, records.begin() + oldest + firstPart, pending.begin());
+        copy(records.begin(), records.begin() + (count - firstPart), pending.begin() + firstPart);
+        pendingCount = count;
+        pendingReason = reason;
+        dumpQueued = true;
+        dumpReady.notify_one();
+        return true;
+    }
+
+    void dumpOnCrash() const {
+        size_t oldest = oldestIndex();
+        size_t firstPart = min(count, records.size() - oldest);
+        writeDump(crashPath, FLIGHT_CRASH, &records[oldest], firstPart, &records[0], count - firstPart);
+    }
+
+    size_t getCount() const { return count; }
+    size_t getCapacity() const { return records.size(); }
+    uint64_t getSkippedDumps() const { return skippedDumps; }
+    float getSpikeThreshold() const { return spikeThreshold; }
+
+    static const char* reasonName(int reason) {
+        static const char* names[FLIGHT_REASON_COUNT] = { "hotkey", "spike", "crash" };
+        return reason >= 0 && reason < FLIGHT_REASON_COUNT ? names[reason] : "unknown";
+    }
+
+    static int decode(const string& path, ostream& out) {
+        FILE* file = fopen(path.c_str(), "rb");
+        Header header;
+        if (!file || fread(&header, sizeof(header), 1, file) != 1 || header.magic != MAGIC ||
+            header.version != VERSION || header.recordSize != sizeof(FlightRecord)) {
+            out << "Cannot read flight dump: " << path << endl;
+            if (file) fclose(file);
+            return 1;
+        }
+
+        vector<FlightRecord> timeline(header.count);
+        size_t read = fread(timeline.data(), sizeof(FlightRecord), timeline.size(), file);
+        fclose(file);
+        timeline.resize(read);
+
+        static const char* states[] = { "menu", "playing", "over", "paused" };
+        out << "Flight dump: " << reasonName(header.reason) << ", " << timeline.size() << " frames, spike threshold "
+            << header.spikeThreshold * 1000 << " ms" << endl;
+        out << "     time   frame interval   work   tick render  enemy  pbul  ebul  miss  pwup  part  +spawn -kill"
+            " hits  alloc      input   state q" << endl;
+
+        char line[256];
+        float worst = 0, total = 0;
+        size_t spikes = 0;
+        double start = timeline.empty() ? 0 : timeline.front().time;
+        for (const auto& r : timeline) {
+            bool spike = header.spikeThreshold > 0 && r.interval > header.spikeThreshold;
+            snprintf(line, sizeof(line),
+                "%9.3f %7u %8.2f %6.2f %6.2f %6.2f %6u %5u %5u %5u %5u %5u %7u %5u %4u %6u %4d,%4d%c %7s %u%s",
+                r.time - start, r.frame, r.interval * 1000, r.workTime * 1000, r.tickTime * 1000, r.renderTime * 1000,
+                r.enemies, r.playerBullets, r.enemyBullets, r.missiles, r.powerUps, r.particles, r.spawned,
+                r.killed, r.playerHits, r.allocations, r.moveX, r.moveY, r.fire ? 'F' : ' ',
+                states[min<unsigned>(r.state, 3)], r.quality, spike ? "  <-- spike" : "");
+            out << line << endl;
+            worst = max(worst, r.interval);
+            total += r.interval;
+            spikes += spike;
+        }
+        if (!timeline.empty()) {
+            out << "Worst interval " << worst * 1000 << " ms, average " << total / timeline.size() * 1000 << " ms, "
+                << spikes << " spikes" << endl;
+        }
+        return 0;
+    }
+};
+
+FlightRecorder* crashFlightRecorder = nullptr;
+
+extern "C" void flightRecorderSignalHandler(int signalNumber) {
+    if (crashFlightRecorder) {
+        crashFlightRecorder->dumpOnCrash();
+        crashFlightRecorder = nullptr;
+    }
+    signal(signalNumber, SIG_DFL);
+    raise(signalNumber);
+}
+
+void installFlightRecorderCrashHandler(FlightRecorder* recorder) {
+    crashFlightRecorder = recorder;
+    signal(SIGSEGV, flightRecorderSignalHandler);
+    signal(SIGABRT, flightRecorderSignalHandler);
+    signal(SIGFPE, flightRecorderSignalHandler);
+    signal(SIGILL, flightRecorderSignalHandler);
+}
+
+struct SpectatorFragment {
+    uint32_t session;
+    uint32_t sequence;
+    uint32_t index;
+    uint32_t count;
+    size_t total;
+    size_t offset;
+    const uint8_t* bytes;
+    size_t length;
+};
+
+class SpectatorCodec {
+public:
+    static const uint32_t PACKET_MAGIC = 0x53505331;
+    static const uint32_t FRAGMENT_MAGIC = 0x53504631;
+    static const uint32_t ACK_MAGIC = 0x53504131;
+    static const size_t ACK_SIZE = 12;
+    static constexpr size_t FRAGMENT_HEADER = 28;
+    static constexpr size_t MAX_FRAGMENTS = 64;
+    static const uint64_t NEW_ENTITY = 1 << SPECTATOR_FIELD_COUNT;
+    static const uint64_t FIELD_MASK = NEW_ENTITY - 1;
+
+    static void writeFixed(uint8_t* out, uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            out[i] = static_cast<uint8_t>(value >> (i * 8));
+        }
+    }
+
+    static uint32_t readFixed(const uint8_t* in) {
+        return in[0] | (in[1] << 8) | (in[2] << 16) | (static_cast<uint32_t>(in[3]) << 24);
+    }
+
+    static void writeVarint(vector<uint8_t>& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    static void writeSigned(vector<uint8_t>& out, int64_t value) {
+        writeVarint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+
+    static bool readVarint(const uint8_t*& in, const uint8_t* end, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && in < end; shift += 7) {
+            uint8_t byte = *in++;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    static bool readSigned(const uint8_t*& in, const uint8_t* end, int64_t& value) {
+        uint64_t raw;
+        if (!readVarint(in, end, raw)) return false;
+        value = static_cast<int64_t>(raw >> 1) ^ -static_cast<int64_t>(raw & 1);
+        return true;
+    }
+
+    static void writeAck(uint8_t* out, uint32_t session, uint32_t sequence) {
+        writeFixed(out, ACK_MAGIC);
+        writeFixed(out + 4, session);
+        writeFixed(out + 8, sequence);
+    }
+
+    static bool readAck(const uint8_t* in, size_t size, uint32_t& session, uint32_t& sequence) {
+        if (size != ACK_SIZE || readFixed(in) != ACK_MAGIC) return false;
+        session = readFixed(in + 4);
+        sequence = readFixed(in + 8);
+        return true;
+    }
+
+    static bool isFragment(const uint8_t* data, size_t size) {
+        return size >= 4 && readFixed(data) == FRAGMENT_MAGIC;
+    }
+
+    static size_t fragmentCount(size_t packetSize, size_t maxDatagram) {
+        size_t payload = maxDatagram - FRAGMENT_HEADER;
+        return (packetSize + payload - 1) / payload;
+    }
+
+    static void writeFragment(vector<uint8_t>& out, uint32_t session, uint32_t sequence, size_t index, size_t count,
+        const vector<uint8_t>& packet) {
+        size_t chunk = (packet.size() + count - 1) / count;
+        size_t offset = index * chunk;
+        size_t length = min(chunk, packet.size() - offset);
+        out.resize(8);
+        writeFixed(out.data(), FRAGMENT_MAGIC);
+        writeFixed(out.data() + 4, session);
+        writeVarint(out, sequence);
+        writeVarint(out, index);
+        writeVarint(out, count);
+        writeVarint(out, packet.size());
+        out.insert(out.end(), packet.begin() + offset, packet.begin() + offset + length);
+    }
+
+    static bool readFragment(const uint8_t* data, size_t size, SpectatorFragment& fragment) {
+        if (size < 8 || !isFragment(data, size)) return false;
+        const uint8_t* in = data + 8;
+        const uint8_t* end = data + size;
+        uint64_t sequence, index, count, total;
+        if (!readVarint(in, end, sequence) || !readVarint(in, end, index) || !readVarint(in, end, count) ||
+            !readVarint(in, end, total)) return false;
+        if (sequence == 0 || sequence > UINT32_MAX || count < 2 || count > MAX_FRAGMENTS || index >= count ||
+            total < count || total > MAX_FRAGMENTS * UdpSocket::MaxDatagramSize) return false;
+
+        size_t chunk = static_cast<size_t>((total + count - 1) / count);
+        size_t offset = static_cast<size_t>(index) * chunk;
+        if (offset >= total || static_cast<size_t>(end - in) != min<size_t>(chunk, total - offset)) return false;
+
+        fragment.session = readFixed(data + 4);
+        fragment.sequence = static_cast<uint32_t>(sequence);
+        fragment.index = static_cast<uint32_t>(index);
+        fragment.count = static_cast<uint32_t>(count);
+        fragment.total = static_cast<size_t>(total);
+        fragment.offset = offset;
+        fragment.bytes = in;
+        fragment.length = static_cast<size_t>(end - in);
+        return true;
+    }
+
+    static void encode(uint32_t session, const SpectatorSnapshot& base, const SpectatorSnapshot& current,
+        vector<uint8_t>& out) {
+        out.resize(8);
+        writeFixed(out.data(), PACKET_MAGIC);
+        writeFixed(out.data() + 4, session);
+        writeVarint(out, current.sequence);
+        writeVarint(out, base.sequence);
+
+        uint64_t globalMask = 0;
+        for (int i = 0; i < SPECTATOR_GLOBAL_COUNT; ++i) {
+            if (current.globals[i] != base.globals[i]) globalMask |= 1ull << i;
+        }
+        writeVarint(out, globalMask);
+        for (int i = 0; i < SPECTATOR_GLOBAL_COUNT; ++i) {
+            if (globalMask & (1ull << i)) {
+                writeSigned(out, static_cast<int64_t>(current.globals[i]) - base.globals[i]);
+            }
+        }
+
+        uint64_t previousKey = 0;
+        size_t b = 0, c = 0;
+        while (b < base.entities.size() || c < current.entities.size()) {
+            const SpectatorEntity* from = b < base.entities.size() ? &base.entities[b] : nullptr;
+            const SpectatorEntity* to = c < current.entities.size() ? &current.entities[c] : nullptr;
+            if (to && (!from || to->key < from->key)) {
+                writeEntity(out, previousKey, nullptr, *to);
+                ++c;
+            }
+            else if (!to || from->key < to->key) {
+                writeVarint(out, from->key - previousKey);
+                writeVarint(out, 0);
+                previousKey = from->key;
+                ++b;
+            }
+            else {
+                writeEntity(out, previousKey, from, *to);
+                ++b;
+                ++c;
+            }
+        }
+        writeVarint(out, 0);
+
+        writeVarint(out, current.effects.size());
+        for (const auto& effect : current.effects) {
+            writeSigned(out, SpectatorSnapshot::quantize(effect.position.x));
+            writeSigned(out, SpectatorSnapshot::quantize(effect.position.y));
+            writeVarint(out, static_cast<uint64_t>(max(effect.bursts, 0)));
+        }
+    }
+
+    static bool readHeader(const uint8_t* data, size_t size, uint32_t& session, uint32_t& sequence, uint32_t& baseline) {
+        if (size < 8 || readFixed(data) != PACKET_MAGIC) return false;
+        session = readFixed(data + 4);
+        const uint8_t* in = data + 8;
+        uint64_t rawSequence, rawBaseline;
+        if (!readVarint(in, data + size, rawSequence) || !readVarint(in, data + size, rawBaseline)) return false;
+        if (rawSequence > UINT32_MAX || rawBaseline >= rawSequence) return false;
+        sequence = static_cast<uint32_t>(rawSequence);
+        baseline = static_cast<uint32_t>(rawBaseline);
+        return true;
+    }
+
+    static bool decode(const SpectatorSnapshot& base, const uint8_t* data, size_t size, SpectatorSnapshot& current) {
+        uint32_t session, sequence, baseline;
+        if (!readHeader(data, size, session, sequence, baseline) || baseline != base.sequence) return false;
+        const uint8_t* in = data + 8;
+        const uint8_t* end = data + size;
+        uint64_t value;
+        readVarint(in, end, value);
+        readVarint(in, end, value);
+
+        current.sequence = sequence;
+        current.entities.clear();
+        current.effects.clear();
+        copy(base.globals, base.globals + SPECTATOR_GLOBAL_COUNT, current.globals);
+
+        uint64_t globalMask;
+        if (!readVarint(in, end, globalMask) || (globalMask >> SPECTATOR_GLOBAL_COUNT)) return false;
+        for (int i = 0; i < SPECTATOR_GLOBAL_COUNT; ++i) {
+            int64_t delta;
+            if (!(globalMask & (1ull << i))) continue;
+            if (!readSigned(in, end, delta)) return false;
+            current.globals[i] = static_cast<int32_t>(current.globals[i] + delta);
+        }
+
+        size_t b = 0;
+        uint64_t key = 0;
+        while (true) {
+            uint64_t keyDelta, tag;
+            if (!readVarint(in, end, keyDelta)) return false;
+            if (keyDelta == 0) break;
+            key += keyDelta;
+            if (!readVarint(in, end, tag) || tag > (NEW_ENTITY | FIELD_MASK)) return false;
+
+            while (b < base.entities.size() && base.entities[b].key < key) {
+                current.entities.push_back(base.entities[b++]);
+            }
+            bool inBase = b < base.entities.size() && base.entities[b].key == key;
+            if (tag == 0) {
+                if (!inBase) return false;
+                ++b;
+                continue;
+            }
+
+            SpectatorEntity entity;
+            if (tag & NEW_ENTITY) {
+                if (inBase) return false;
+                entity.key = key;
+                fill(entity.fields, entity.fields + SPECTATOR_FIELD_COUNT, 0);
+            }
+            else {
+                if (!inBase) return false;
+                entity = base.entities[b++];
+            }
+            for (int i = 0; i < SPECTATOR_FIELD_COUNT; ++i) {
+                int64_t delta;
+                if (!(tag & (1ull << i))) continue;
+                if (!readSigned(in, end, delta)) return false;
+                entity.fields[i] = static_cast<int32_t>(entity.fields[i] + delta);
+            }
+            current.entities.push_back(entity);
+        }
+        current.entities.insert(current.entities.end(), base.entities.begin() + b, base.entities.end());
+
+        uint64_t effectCount;
+        if (!readVarint(in, end, effectCount) || effectCount > static_cast<uint64_t>(end - in)) return false;
+        for (uint64_t i = 0; i < effectCount; ++i) {
+            int64_t x, y;
+            uint64_t bursts;
+            if (!readSigned(in, end, x) || !readSigned(in, end, y) || !readVarint(in, end, bursts)) return false;
+            current.effects.push_back(EffectEvent(Vector2f(x / SPECTATOR_POSITION_SCALE, y / SPECTATOR_POSITION_SCALE),
+                static_cast<int>(min<uint64_t>(bursts, 8))));
+        }
+        return in == end;
+    }
+
+private:
+    static void writeEntity(vector<uint8_t>& out, uint64_t& previousKey, const SpectatorEntity* from,
+        const SpectatorEntity& to) {
+        uint64_t tag = from ? 0 : NEW_ENTITY;
+        for (int i = 0; i < SPECTATOR_FIELD_COUNT; ++i) {
+            if (to.fields[i] != (from ? from->fields[i] : 0)) tag |= 1ull << i;
+        }
+        if (tag == 0) return;
+
+        writeVarint(out, to.key - previousKey);
+        writeVarint(out, tag);
+        previousKey = to.key;
+        for (int i = 0; i < SPECTATOR_FIELD_COUNT; ++i) {
+            if (tag & (1ull << i)) {
+                writeSigned(out, static_cast<int64_t>(to.fields[i]) - (from ? from->fields[i] : 0));
+            }
+        }
+    }
+};
+
+class SpectatorBroadcaster {
+public:
+    static constexpr uint32_t HISTORY = 64;
+    static constexpr size_t MAX_VIEWERS = 64;
+    static constexpr double VIEWER_TIMEOUT = 5.0;
+
+private:
+    struct Viewer {
+        IpAddress address;
+        unsigned short port;
+        uint32_t acked;
+        double lastHeard;
+    };
+
+    struct Encoding {
+        uint32_t baseline;
+        vector<uint8_t> bytes;
+    };
+
+    UdpSocket socket;
+    bool listening;
+    SpectatorSnapshot history[HISTORY];
+    SpectatorSnapshot emptySnapshot;
+    uint32_t session;
+    uint32_t sequence;
+    vector<Viewer> viewers;
+    vector<Encoding> encodings;
+    size_t encodingCount;
+    size_t maxDatagram;
+    vector<uint8_t> fragment;
+    size_t lastBytes;
+    float lastEncodeSeconds;
+    float lastSendSeconds;
+    uint64_t totalBytes;
+    uint64_t sentPackets;
+    uint64_t fragmentedPackets;
+    uint64_t droppedPackets;
+    uint64_t oversizePackets;
+    uint64_t broadcastTicks;
+    double totalEncodeSeconds;
+
+    bool sendTo(const Viewer& viewer, const vector<uint8_t>& packet) {
+        if (packet.size() <= maxDatagram) {
+            if (socket.send(packet.data(), packet.size(), viewer.address, viewer.port) != Socket::Done) return false;
+            lastBytes += packet.size();
+            return true;
+        }
+
+        size_t count = SpectatorCodec::fragmentCount(packet.size(), maxDatagram);
+        for (size_t i = 0; i < count; ++i) {
+            SpectatorCodec::writeFragment(fragment, session, sequence, i, count, packet);
+            if (socket.send(fragment.data(), fragment.size(), viewer.address, viewer.port) != Socket::Done) return false;
+            lastBytes += fragment.size();
+        }
+        ++fragmentedPackets;
+        return true;
+    }
+
+    void receiveAcks(double now) {
+        uint8_t message[SpectatorCodec::ACK_SIZE + 1];
+        size_t received;
+        IpAddress address;
+        unsigned short port;
+        while (socket.receive(message, sizeof(message), received, address, port) == Socket::Done) {
+            uint32_t ackSession, acked;
+            if (!SpectatorCodec::readAck(message, received, ackSession, acked)) continue;
+            if (ackSession != session) {
+                acked = 0;
+            }
+            if (acked > sequence) continue;
+
+            auto viewer = find_if(viewers.begin(), viewers.end(),
+                [&](const Viewer& v) { return v.address == address && v.port == port; });
+            if (viewer == viewers.end()) {
+                if (viewers.size() >= MAX_VIEWERS) continue;
+                viewers.push_back(Viewer{ address, port, 0, now });
+                viewer = viewers.end() - 1;
+            }
+            if (acked == 0 || acked > viewer->acked) {
+                viewer->acked = acked;
+            }
+            viewer->lastHeard = now;
+        }
+
+        viewers.erase(remove_if(viewers.begin(), viewers.end(),
+            [now](const Viewer& v) { return now - v.lastHeard > VIEWER_TIMEOUT; }), viewers.end());
+    }
+
+    static uint32_t newSession() {
+        uint64_t wall = static_cast<uint64_t>(chrono::system_clock::now().time_since_epoch().count());
+        uint64_t steady = static_cast<uint64_t>(chrono::steady_clock::now().time_since_epoch().count());
+        return static_cast<uint32_t>(hashCombine(wall, steady)) | 1;
+    }
+
+    const SpectatorSnapshot& baselineFor(uint32_t acked) const {
+        if (acked == 0 || sequence - acked >= HISTORY) return emptySnapshot;
+        const SpectatorSnapshot& snapshot = history[acked % HISTORY];
+        return snapshot.sequence == acked ? snapshot : emptySnapshot;
+    }
+
+    const vector<uint8_t>& encodingFor(const SpectatorSnapshot& base, const SpectatorSnapshot& current) {
+        for (size_t i = 0; i < encodingCount; ++i) {
+            if (encodings[i].baseline == base.sequence) return encodings[i].bytes;
+        }
+        if (encodingCount == encodings.size()) {
+            encodings.emplace_back();
+        }
+        Encoding& encoding = encodings[encodingCount++];
+        encoding.baseline = base.sequence;
+        SpectatorCodec::encode(session, base, current, encoding.bytes);
+        return encoding.bytes;
+    }
+
+public:
+    SpectatorBroadcaster() : listening(false), session(newSession()), sequence(0), encodingCount(0),
+        maxDatagram(UdpSocket::MaxDatagramSize), lastBytes(0), lastEncodeSeconds(0), lastSendSeconds(0), totalBytes(0), sentPackets(0), fragmentedPackets(0),
+        droppedPackets(0), oversizePackets(0), broadcastTicks(0), totalEncodeSeconds(0) {
+        viewers.reserve(MAX_VIEWERS);
+        encodings.reserve(MAX_VIEWERS);
+        fragment.reserve(maxDatagram);
+    }
+
+    void setMaxDatagram(size_t size) {
+        maxDatagram = max(SpectatorCodec::FRAGMENT_HEADER + 64, min<size_t>(size, UdpSocket::MaxDatagramSize));
+        fragment.reserve(maxDatagram);
+    }
+
+    bool listen(unsigned short port) {
+        socket.setBlocking(false);
+        listening = socket.bind(port, IpAddress::LocalHost) == Socket::Done;
+        return listening;
+    }
+
+    void broadcast(const GameWorld& world, int state) {
+        if (!listening) return;
+        receiveAcks(monotonicSeconds());
+        ++sequence;
+        lastBytes = 0;
+        lastEncodeSeconds = 0;
+        lastSendSeconds = 0;
+        encodingCount = 0;
+        if (viewers.empty()) return;
+
+        auto start = chrono::steady_clock::now();
+        SpectatorSnapshot& current = history[sequence % HISTORY];
+        world.captureSnapshot(current);
+        current.sequence = sequence;
+        current.globals[SPECTATOR_STATE] = state;
+        for (const auto& viewer : viewers) {
+            encodingFor(baselineFor(viewer.acked), current);
+        }
+        auto encoded = chrono::steady_clock::now();
+        lastEncodeSeconds = chrono::duration<float>(encoded - start).count();
+
+        for (const auto& viewer : viewers) {
+            const vector<uint8_t>& packet = encodingFor(baselineFor(viewer.acked), current);
+            if (SpectatorCodec::fragmentCount(packet.size(), maxDatagram) > SpectatorCodec::MAX_FRAGMENTS) {
+                ++oversizePackets;
+                continue;
+            }
+            if (!sendTo(viewer, packet)) {
+                ++droppedPackets;
+                continue;
+            }
+            ++sentPackets;
+        }
+        lastSendSeconds = chrono::duration<float>(chrono::steady_clock::now() - encoded).count();
+        totalBytes += lastBytes;
+        totalEncodeSeconds += lastEncodeSeconds;
+        ++broadcastTicks;
+    }
+
+    unsigned short getPort() const { return socket.getLocalPort(); }
+    bool isListening() const { return listening; }
+    uint32_t getSession() const { return session; }
+    uint32_t getSequence() const { return sequence; }
+    const SpectatorSnapshot& getLatest() const { return history[sequence % HISTORY]; }
+    size_t getViewerCount() const { return viewers.size(); }
+    size_t getLastBytes() const { return lastBytes; }
+    size_t getLastEncodings() const { return encodingCount; }
+    float getLastEncodeSeconds() const { return lastEncodeSeconds; }
+    float getLastSendSeconds() const { return lastSendSeconds; }
+    uint64_t getDroppedPackets() const { return droppedPackets; }
+    uint64_t getFragmentedPackets() const { return fragmentedPackets; }
+    uint64_t getOversizePackets() const { return oversizePackets; }
+
+    void printStats(ostream& out) const {
+        if (broadcastTicks == 0) return;
+        out << "Spectator broadcast: " << broadcastTicks << " ticks, " << sentPackets << " packets ("
+            << fragmentedPackets << " fragmented), " << totalBytes / broadcastTicks << " bytes/tick, encode "
+            << totalEncodeSeconds / broadcastTicks * 1e6 << " us/tick, dropped " << droppedPackets << ", oversize "
+            << oversizePackets << endl;
+    }
+};
+
+class SpectatorClient {
+public:
+    static constexpr double ACK_RESEND = 0.25;
+
+private:
+    UdpSocket socket;
+    IpAddress server;
+    unsigned short serverPort;
+    SpectatorSnapshot history[SpectatorBroadcaster::HISTORY];
+    SpectatorSnapshot emptySnapshot;
+    uint32_t session;
+    uint32_t latest;
+    uint32_t ackInterval;
+    vector<uint8_t> packet;
+    vector<uint8_t> assembly;
+    uint32_t assemblySession;
+    uint32_t assemblySequence;
+    uint64_t assemblyMask;
+    uint64_t assemblyComplete;
+    vector<EffectEvent> effects;
+    double lastAckTime;
+    size_t lastBytes;
+    float lastDecodeSeconds;
+    uint64_t receivedPackets;
+    uint64_t droppedPackets;
+
+    void sendAck(double now) {
+        uint8_t message[SpectatorCodec::ACK_SIZE];
+        SpectatorCodec::writeAck(message, session, latest);
+        socket.send(message, sizeof(message), server, serverPort);
+        lastAckTime = now;
+    }
+
+    bool assemble(size_t size, bool& complete) {
+        SpectatorFragment fragment;
+        if (!SpectatorCodec::readFragment(packet.data(), size, fragment)) return false;
+        uint64_t expected = ~0ull >> (64 - fragment.count);
+        if (fragment.session != assemblySession || fragment.sequence != assemblySequence ||
+            assembly.size() != fragment.total || assemblyComplete != expected) {
+            assembly.resize(fragment.total);
+            assemblySession = fragment.session;
+            assemblySequence = fragment.sequence;
+            assemblyMask = 0;
+            assemblyComplete = expected;
+        }
+        copy(fragment.bytes, fragment.bytes + fragment.length, assembly.begin() + fragment.offset);
+        assemblyMask |= 1ull << fragment.index;
+        complete = assemblyMask == assemblyComplete;
+        if (complete) {
+            assemblySequence = 0;
+        }
+        return true;
+    }
+
+    bool accept(const uint8_t* data, size_t size) {
+        uint32_t packetSession, sequence, baseline;
+        if (!SpectatorCodec::readHeader(data, size, packetSession, sequence, baseline)) return false;
+        if (packetSession != session) {
+            if (baseline != 0) return false;
+            for (auto& snapshot : history) {
+                snapshot.sequence = 0;
+            }
+            session = packetSession;
+            latest = 0;
+        }
+        if (sequence <= latest) return false;
+        if (baseline != 0 && sequence - baseline >= SpectatorBroadcaster::HISTORY) return false;
+
+        const SpectatorSnapshot& base = baseline ? history[baseline % SpectatorBroadcaster::HISTORY] : emptySnapshot;
+        SpectatorSnapshot& target = history[sequence % SpectatorBroadcaster::HISTORY];
+        if (base.sequence != baseline || !SpectatorCodec::decode(base, data, size, target)) {
+            target.sequence = 0;
+            return false;
+        }
+        latest = sequence;
+        effects.insert(effects.end(), target.effects.begin(), target.effects.end());
+        return true;
+    }
+
+public:
+    SpectatorClient() : serverPort(0), session(0), latest(0), ackInterval(1), packet(UdpSocket::MaxDatagramSize),
+        assemblySession(0), assemblySequence(0), assemblyMask(0), assemblyComplete(0), lastAckTime(-1e9), lastBytes(0), lastDecodeSeconds(0), receivedPackets(0),
+        droppedPackets(0) {
+        effects.reserve(64);
+    }
+
+    bool connect(const IpAddress& address, unsigned short port) {
+        server = address;
+        serverPort = port;
+        socket.setBlocking(false);
+        return socket.bind(Socket::AnyPort, IpAddress::LocalHost) == Socket::Done;
     }
 
-    void heal(int amount) {
-        health += amount;
-        if (health > 100) health = 100;
+    void setAckInterval(uint32_t interval) { ackInterval = max(interval, 1u); }
+
+    bool poll(double now) {
+        auto start = chrono::steady_clock::now();
+        bool updated = false;
+        size_t received;
+        IpAddress address;
+        unsigned short port;
+        lastBytes = 0;
+        while (socket.receive(packet.data(), packet.size(), received, address, port) == Socket::Done) {
+            if (address != server || port != serverPort) continue;
+            lastBytes += received;
+            const uint8_t* data = packet.data();
+            if (SpectatorCodec::isFragment(data, received)) {
+                bool complete = false;
+                if (!assemble(received, complete)) {
+                    ++droppedPackets;
+                    continue;
+                }
+                if (!complete) continue;
+                data = assembly.data();
+                received = assembly.size();
+            }
+            if (accept(data, received)) {
+                updated = true;
+                ++receivedPackets;
+            }
+            else {
+                ++droppedPackets;
+            }
+        }
+        lastDecodeSeconds = chrono::duration<float>(chrono::steady_clock::now() - start).count();
+
+        if ((updated && latest % ackInterval == 0) || now - lastAckTime > ACK_RESEND) {
+            sendAck(now);
+        }
+        return updated;
     }
 
-    const RectangleShape& getShape() const { return shape; }
-    const Vector2f& getPosition() const { return position; }
-    int getHealth() const { return health; }
-    bool getIsAlive() const { return isAlive; }
-    int getScore() const { return score; }
-    float getShootCooldown() const { return shootCooldown; }
-    float getMaxShootCooldown() const { return maxShootCooldown; }
+    bool hasSnapshot() const { return latest != 0; }
+    const SpectatorSnapshot& getLatest() const { return history[latest % SpectatorBroadcaster::HISTORY]; }
+    const vector<EffectEvent>& getEffects() const { return effects; }
+    void clearEffects() { effects.clear(); }
+    unsigned short getServerPort() const { return serverPort; }
+    size_t getLastBytes() const { return lastBytes; }
+    float getLastDecodeSeconds() const { return lastDecodeSeconds; }
+    uint64_t getReceivedPackets() const { return receivedPackets; }
+    uint64_t getDroppedPackets() const { return droppedPackets; }
 };
 
-class EnemyShip {
-private:
-    CircleShape shape;
-    Vector2f position;
-    Velocity velocity;
-    int health;
-    int maxHealth;
-    int damage;
-    int points;
-    float shootTimer;
-    float shootInterval;
-    bool isBoss;
+enum RenderLayer {
+    LAYER_DECORATIONS,
+    LAYER_SHIPS,
+    LAYER_BULLETS,
+    LAYER_POWER_UPS,
+    LAYER_PARTICLES,
+    LAYER_HUD,
+    RENDER_LAYER_COUNT
+};
 
+class RenderFrontEnd {
 public:
-    EnemyShip(bool boss = false) : isBoss(boss), position(0, 0), velocity(0, 0),
-        health(0), maxHealth(0), damage(0), points(0),
-        shootTimer(0), shootInterval(0) {
-        if (boss) {
-            shape.setRadius(40);
-            shape.setFillColor(Color(200, 50, 50));
-            shape.setOutlineColor(Color::Red);
-            shape.setOutlineThickness(2);
-            maxHealth = health = 500;
-            damage = 30;
-            points = 500;
-            shootInterval = 1.5f;
-            velocity = Velocity(0, 50);
-        }
-        else {
-            shape.setRadius(20);
-            shape.setFillColor(Color::Red);
-            shape.setOutlineColor(Color(255, 100, 100));
-            shape.setOutlineThickness(2);
-            maxHealth = health = 50;
-            damage = 10;
-            points = 100;
-            shootInterval = 2.0f;
-            velocity = Velocity((rand() % 100) - 50, (rand() % 50) + 50);
-        }
-
-        shape.setOrigin(shape.getRadius(), shape.getRadius());
+    static constexpr size_t MAX_PARTICLE_JOBS = 16;
 
-        position = Vector2f(rand() % (WINDOW_WIDTH - 100) + 50, -50);
-        shape.setPosition(position);
+private:
+    static const int CIRCLE_POINTS = 30;
+    static const int BULLET_POINT_STEP = 3;
+    static const size_t DEFAULT_SERIAL_WORKLOAD = 16384;
+    static const size_t FIXED_JOBS = RENDER_LAYER_COUNT - 1;
+
+    WorkerPool pool;
+    vector<Vertex> layers[RENDER_LAYER_COUNT];
+    vector<Vertex> particleBuffers[MAX_PARTICLE_JOBS];
+    float jobSeconds[FIXED_JOBS + MAX_PARTICLE_JOBS];
+    float layerSeconds[RENDER_LAYER_COUNT];
+    size_t particleJobs;
+    size_t serialWorkload;
+    float buildSeconds;
+    bool lastBuildParallel;
+    Vector2f unitCircle[CIRCLE_POINTS];
+
+    const GameWorld* world;
+    const ParticleSystem* const* particleSystems;
+
+    RectangleShape powerUpShape;
+    RectangleShape bossHealthBar;
+    RectangleShape bossHealthFill;
+    RectangleShape playerHealthBar;
+    RectangleShape playerHealthFill;
+    RectangleShape cooldownBar;
+    RectangleShape cooldownFill;
+    RectangleShape statusFill;
+
+    static unsigned defaultThreadCount() {
+        return max(1u, min(4u, thread::hardware_concurrency() / 2));
+    }
 
-        shootTimer = (rand() % 100) / 100.f * shootInterval;
+    void appendTriangle(vector<Vertex>& out, Vector2f a, Vector2f b, Vector2f c, Color color) const {
+        out.push_back(Vertex(a, color));
+        out.push_back(Vertex(b, color));
+        out.push_back(Vertex(c, color));
     }
 
-    void update(float deltaTime) {
-        position.x += velocity.x * deltaTime;
-        position.y += velocity.y * deltaTime;
+    void appendQuad(vector<Vertex>& out, Vector2f a, Vector2f b, Vector2f c, Vector2f d, Color color) const {
+        appendTriangle(out, a, b, c, color);
+        appendTriangle(out, a, c, d, color);
+    }
 
-        float radius = shape.getRadius();
-        if (position.x < radius) {
-            position.x = radius;
-            velocity.x = -velocity.x;
-        }
-        if (position.x > WINDOW_WIDTH - radius) {
-            position.x = WINDOW_WIDTH - radius;
-            velocity.x = -velocity.x;
+    void appendCircle(vector<Vertex>& out, Vector2f center, float radius, Color fill, Color outline,
+        float thickness, int step = 1) const {
+        float outer = radius + thickness;
+        for (int i = 0; i < CIRCLE_POINTS; i += step) {
+            const Vector2f& a = unitCircle[i];
+            const Vector2f& b = unitCircle[(i + step) % CIRCLE_POINTS];
+            appendTriangle(out, center, center + a * radius, center + b * radius, fill);
+            if (thickness > 0) {
+                appendQuad(out, center + a * radius, center + a * outer, center + b * outer, center + b * radius, outline);
+            }
         }
+    }
 
-        shape.setPosition(position);
+    void appendRect(vector<Vertex>& out, const RectangleShape& shape) const {
+        Vector2f topLeft = shape.getPosition() - shape.getOrigin();
+        Vector2f size = shape.getSize();
+        float t = shape.getOutlineThickness();
+        Vector2f a = topLeft, b(topLeft.x + size.x, topLeft.y), c = topLeft + size, d(topLeft.x, topLeft.y + size.y);
+        appendQuad(out, a, b, c, d, shape.getFillColor());
+        if (t > 0) {
+            Color outline = shape.getOutlineColor();
+            appendQuad(out, a - Vector2f(t, t), b + Vector2f(t, -t), b, a, outline);
+            appendQuad(out, b + Vector2f(t, -t), c + Vector2f(t, t), c, b, outline);
+            appendQuad(out, c + Vector2f(t, t), d + Vector2f(-t, t), d, c, outline);
+            appendQuad(out, d + Vector2f(-t, t), a - Vector2f(t, t), a, d, outline);
+        }
+    }
 
-        shootTimer += deltaTime;
+    void buildDecorations(vector<Vertex>& out) const {
+        float viewTop = world->getCameraTop();
+        const vector<WorldChunk>& chunks = world->getChunks();
+        int firstChunk = max(0, static_cast<int>(viewTop) / CHUNK_HEIGHT - 1);
+        int lastChunk = min(LEVEL_CHUNKS - 1, static_cast<int>(viewTop + WINDOW_HEIGHT) / CHUNK_HEIGHT + 1);
+        for (int c = firstChunk; c <= lastChunk; ++c) {
+            for (const auto& decoration : chunks[c].decorations) {
+                appendCircle(out, decoration.position, decoration.radius,
+                    Color(decoration.shade, decoration.shade, decoration.shade + 20),
+                    Color(decoration.shade + 40, decoration.shade + 40, decoration.shade + 60), 1);
+            }
+        }
     }
 
-    bool canShoot() const {
-        return shootTimer >= shootInterval;
+    void buildShips(vector<Vertex>& out) {
+        const PlayerShip& player = world->getPlayer();
+        if (player.getIsAlive()) {
+            appendRect(out, player.getShape());
+            if (player.getIsShielded()) {
+                appendCircle(out, player.getPosition(), 44, Color(80, 140, 255, 60), Color(150, 200, 255, 180), 2);
+            }
+        }
+
+        FloatRect visibleArea(0, world->getCameraTop(), WINDOW_WIDTH, WINDOW_HEIGHT);
+        for (const auto& enemy : world->getEnemies()) {
+            if (!enemy.isAlive() || !visibleArea.intersects(enemy.getBounds())) continue;
+
+            appendCircle(out, enemy.getPosition(), enemy.getRadius(), enemy.getFillColor(), enemy.getOutlineColor(), 2);
+            if (enemy.getIsBoss()) {
+                Vector2f barPosition(enemy.getPosition().x - 50, enemy.getPosition().y - 60);
+                float healthPercent = static_cast<float>(enemy.getHealth()) / enemy.getMaxHealth();
+                bossHealthBar.setPosition(barPosition);
+                bossHealthFill.setSize(Vector2f(100 * healthPercent, 10));
+                bossHealthFill.setPosition(barPosition);
+                appendRect(out, bossHealthBar);
+                appendRect(out, bossHealthFill);
+            }
+        }
     }
 
-    void resetShootTimer() {
-        shootTimer = 0;
+    void buildBullets(vector<Vertex>& out) const {
+        for (const auto& bullet : world->getPlayerBullets()) {
+            appendCircle(out, bullet.position, 5, Color::Yellow, Color::Red, 2, BULLET_POINT_STEP);
+        }
+        for (const auto& bullet : world->getEnemyBullets()) {
+            appendCircle(out, bullet.position, 4, Color::Magenta, Color(255, 100, 255), 1, BULLET_POINT_STEP);
+        }
+        for (const auto& missile : world->getPlayerMissiles()) {
+            appendCircle(out, missile.position, 4, Color(255, 150, 0), Color::Magenta, 1, BULLET_POINT_STEP);
+        }
     }
 
-    CircleShape createBullet() const {
-        CircleShape bullet(4);
-        bullet.setFillColor(Color::Magenta);
-        bullet.setOutlineColor(Color(255, 100, 255));
-        bullet.setOutlineThickness(1);
-        bullet.setOrigin(4, 4);
-        bullet.setPosition(position.x, position.y + shape.getRadius() + 10);
-        return bullet;
+    void buildPowerUps(vector<Vertex>& out) {
+        for (const auto& powerUp : world->getPowerUps()) {
+            powerUpShape.setFillColor(powerUp.getFillColor());
+            powerUpShape.setPosition(powerUp.getPosition());
+            appendRect(out, powerUpShape);
+        }
     }
 
-    void takeDamage(int damage) {
-        health -= damage;
-        float healthPercent = static_cast<float>(health) / maxHealth;
+    void buildHud(vector<Vertex>& out) {
+        const PlayerShip& player = world->getPlayer();
+        if (player.getIsAlive()) {
+            playerHealthFill.setSize(Vector2f(200 * (player.getHealth() / 100.f), 15));
+            appendRect(out, playerHealthBar);
+            appendRect(out, playerHealthFill);
+        }
 
-        if (isBoss) {
-            Color newColor(200, static_cast<Uint8>(50 * healthPercent),
-                static_cast<Uint8>(50 * healthPercent));
-            shape.setFillColor(newColor);
+        float cooldownPercent = player.getShootCooldown() / player.getMaxShootCooldown();
+        cooldownFill.setSize(Vector2f(200 * (1 - cooldownPercent), 10));
+        appendRect(out, cooldownBar);
+        appendRect(out, cooldownFill);
+
+        const StatusEffects& effects = world->getStatusEffects();
+        float barY = 62;
+        for (int type = 0; type < POWER_UP_TYPE_COUNT; ++type) {
+            const PowerUpStats& stats = POWER_UP_STATS[type];
+            if (stats.statusEffect < 0) continue;
+            float remaining = effects.getRemaining(static_cast<StatusEffectType>(stats.statusEffect));
+            if (remaining <= 0) continue;
+            statusFill.setFillColor(powerUpColor(type));
+            statusFill.setSize(Vector2f(200 * min(1.f, remaining / stats.duration), 6));
+            statusFill.setPosition(WINDOW_WIDTH - 220, barY);
+            appendRect(out, statusFill);
+            barY += 10;
         }
     }
 
-    bool isAlive() const {
-        return health > 0;
+    static int fixedJobLayer(size_t job) {
+        return job < LAYER_PARTICLES ? static_cast<int>(job) : static_cast<int>(LAYER_HUD);
     }
 
-    bool isOffScreen() const {
-        return position.y > WINDOW_HEIGHT + 100;
+    void runJob(size_t job) {
+        auto start = chrono::steady_clock::now();
+        if (job >= FIXED_JOBS) {
+            vector<Vertex>& out = particleBuffers[job - FIXED_JOBS];
+            out.clear();
+            particleSystems[job - FIXED_JOBS]->appendVertices(out);
+        }
+        else {
+            int layer = fixedJobLayer(job);
+            vector<Vertex>& out = layers[layer];
+            out.clear();
+            switch (layer) {
+            case LAYER_DECORATIONS:
+                buildDecorations(out);
+                break;
+            case LAYER_SHIPS:
+                buildShips(out);
+                break;
+            case LAYER_BULLETS:
+                buildBullets(out);
+                break;
+            case LAYER_POWER_UPS:
+                buildPowerUps(out);
+                break;
+            default:
+                buildHud(out);
+                break;
+            }
+        }
+        jobSeconds[job] = chrono::duration<float>(chrono::steady_clock::now() - start).count();
     }
 
-    const CircleShape& getShape() const { return shape; }
-    const Vector2f& getPosition() const { return position; }
-    int getDamage() const { return damage; }
-    int getPoints() const { return points; }
-    int getHealth() const { return health; }
-    int getMaxHealth() const { return maxHealth; }
-    bool getIsBoss() const { return isBoss; }
-    float getRadius() const { return shape.getRadius(); }
-};
+public:
+    explicit RenderFrontEnd(unsigned threadCount = defaultThreadCount())
+        : pool(threadCount), particleJobs(0), serialWorkload(DEFAULT_SERIAL_WORKLOAD), buildSeconds(0), lastBuildParallel(false), world(nullptr),
+        particleSystems(nullptr) {
+        for (int i = 0; i < CIRCLE_POINTS; ++i) {
+            float angle = i * 2 * PI / CIRCLE_POINTS - PI / 2;
+            unitCircle[i] = Vector2f(cos(angle), sin(angle));
+        }
+        fill(jobSeconds, jobSeconds + FIXED_JOBS + MAX_PARTICLE_JOBS, 0.f);
+        fill(layerSeconds, layerSeconds + RENDER_LAYER_COUNT, 0.f);
+
+        layers[LAYER_DECORATIONS].reserve(64 * CIRCLE_POINTS * 9);
+        layers[LAYER_SHIPS].reserve(256 * CIRCLE_POINTS * 9);
+        layers[LAYER_BULLETS].reserve(1024 * CIRCLE_POINTS / BULLET_POINT_STEP * 9);
+        layers[LAYER_POWER_UPS].reserve(32 * 30);
+        layers[LAYER_HUD].reserve(10 * 30);
+        for (auto& buffer : particleBuffers) {
+            buffer.reserve(512);
+        }
 
-class PowerUp {
-private:
-    RectangleShape shape;
-    Vector2f position;
-    Velocity velocity;
-    int type;
-    float activeTime;
+        powerUpShape.setSize(Vector2f(30, 30));
+        powerUpShape.setOrigin(15, 15);
+        powerUpShape.setOutlineColor(Color::White);
+        powerUpShape.setOutlineThickness(2);
+
+        bossHealthBar.setSize(Vector2f(100, 10));
+        bossHealthBar.setFillColor(Color::Red);
+        bossHealthBar.setOutlineColor(Color::White);
+        bossHealthBar.setOutlineThickness(1);
+        bossHealthFill.setFillColor(Color::Green);
+
+        playerHealthBar.setSize(Vector2f(200, 15));
+        playerHealthBar.setFillColor(Color::Black);
+        playerHealthBar.setOutlineColor(Color::White);
+        playerHealthBar.setOutlineThickness(1);
+        playerHealthBar.setPosition(WINDOW_WIDTH - 220, 20);
+        playerHealthFill.setFillColor(Color::Green);
+        playerHealthFill.setPosition(WINDOW_WIDTH - 220, 20);
+
+        cooldownBar.setSize(Vector2f(200, 10));
+        cooldownBar.setFillColor(Color::Black);
+        cooldownBar.setOutlineColor(Color::White);
+        cooldownBar.setOutlineThickness(1);
+        cooldownBar.setPosition(WINDOW_WIDTH - 220, 45);
+        cooldownFill.setFillColor(Color::Yellow);
+        cooldownFill.setPosition(WINDOW_WIDTH - 220, 45);
+    }
 
-public:
-    PowerUp(Vector2f pos) : position(pos), velocity(0, 100), type(0), activeTime(10.0f) {
-        type = rand() % 3;
+    void build(const GameWorld& source, const ParticleSystem* const* systems, size_t systemCount) {
+        auto start = chrono::steady_clock::now();
+        world = &source;
+        particleSystems = systems;
+        particleJobs = min(systemCount, MAX_PARTICLE_JOBS);
 
-        shape.setSize(Vector2f(30, 30));
-        shape.setOrigin(15, 15);
-        shape.setPosition(position);
+        size_t workload = source.getEnemies().size() * CIRCLE_POINTS * 9 + (source.getPlayerBullets().size() +
+            source.getEnemyBullets().size() + source.getPlayerMissiles().size()) * CIRCLE_POINTS / BULLET_POINT_STEP * 9;
+        for (size_t i = 0; i < particleJobs; ++i) {
+            workload += systems[i]->getParticleCount();
+        }
 
-        switch (type) {
-        case 0:
-            shape.setFillColor(Color::Green);
-            break;
-        case 1:
-            shape.setFillColor(Color::Cyan);
-            break;
-        case 2:
-            shape.setFillColor(Color::Yellow);
-            break;
+        size_t jobCount = FIXED_JOBS + particleJobs;
+        auto job = [this](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                runJob(i);
+            }
+        };
+        lastBuildParallel = workload >= serialWorkload && pool.getThreadCount() > 1;
+        if (lastBuildParallel) {
+            pool.parallelFor(jobCount, job);
+        }
+        else {
+            job(0, jobCount);
         }
 
-        shape.setOutlineColor(Color::White);
-        shape.setOutlineThickness(2);
+        for (size_t i = 0; i < FIXED_JOBS; ++i) {
+            layerSeconds[fixedJobLayer(i)] = jobSeconds[i];
+        }
+        layerSeconds[LAYER_PARTICLES] = 0;
+        for (size_t i = 0; i < particleJobs; ++i) {
+            layerSeconds[LAYER_PARTICLES] += jobSeconds[FIXED_JOBS + i];
+        }
+        buildSeconds = chrono::duration<float>(chrono::steady_clock::now() - start).count();
     }
 
-    void update(float deltaTime) {
-        position += Vector2f(velocity.x * deltaTime, velocity.y * deltaTime);
-        shape.setPosition(position);
-
-        float pulse = sin(activeTime * 5) * 0.5f + 0.5f;
-        shape.setFillColor(Color(
-            static_cast<Uint8>(shape.getFillColor().r * pulse),
-            static_cast<Uint8>(shape.getFillColor().g * pulse),
-            static_cast<Uint8>(shape.getFillColor().b * pulse)
-        ));
-
-        activeTime += deltaTime;
+    void submitWorld(RenderTarget& target) const {
+        for (int layer = LAYER_DECORATIONS; layer < LAYER_PARTICLES; ++layer) {
+            if (!layers[layer].empty()) {
+                target.draw(layers[layer].data(), layers[layer].size(), Triangles);
+            }
+        }
+        for (size_t i = 0; i < particleJobs; ++i) {
+            if (!particleBuffers[i].empty()) {
+                target.draw(particleBuffers[i].data(), particleBuffers[i].size(), Points);
+            }
+        }
     }
 
-    bool isOffScreen() const {
-        return position.y > WINDOW_HEIGHT + 50;
+    void submitHud(RenderTarget& target) const {
+        if (!layers[LAYER_HUD].empty()) {
+            target.draw(layers[LAYER_HUD].data(), layers[LAYER_HUD].size(), Triangles);
+        }
     }
 
-    void applyEffect(PlayerShip& player) {
-        switch (type) {
-        case 0:
-            player.heal(30);
-            break;
+    size_t getVertexCount(int layer) const {
+        if (layer != LAYER_PARTICLES) return layers[layer].size();
+        size_t count = 0;
+        for (size_t i = 0; i < particleJobs; ++i) {
+            count += particleBuffers[i].size();
         }
+        return count;
     }
 
-    const RectangleShape& getShape() const { return shape; }
-    const Vector2f& getPosition() const { return position; }
-    int getType() const { return type; }
+    void setSerialWorkload(size_t vertices) { serialWorkload = vertices; }
+
+    float getLayerSeconds(int layer) const { return layerSeconds[layer]; }
+    float getBuildSeconds() const { return buildSeconds; }
+    bool wasLastBuildParallel() const { return lastBuildParallel; }
+    unsigned getThreadCount() const { return pool.getThreadCount(); }
+
+    static const char* layerName(int layer) {
+        static const char* names[RENDER_LAYER_COUNT] = { "decor", "ships", "bullets", "power-ups", "particles", "hud" };
+        return names[layer];
+    }
 };
 
 class SpaceShooterGame {
 private:
+    static constexpr size_t MAX_PARTICLE_SYSTEMS = 11;
+    static const int STEADY_STATE_FRAMES = 120;
+    static const size_t REPLAY_RESERVED_FRAMES = 60 * 60 * 15;
+    static constexpr double SPIKE_DUMP_COOLDOWN = 10.0;
+
     RenderWindow window;
+    RenderTarget* canvas;
+    RenderTexture captureTexture;
+    unique_ptr<FrameCapture> capture;
+    bool fixedTimestep;
     GameState currentState;
 
-    PlayerShip player;
-
-    vector<EnemyShip> enemies;
-    float enemySpawnTimer;
-    float enemySpawnInterval;
-    int waveNumber;
-    int enemiesPerWave;
-    int enemiesSpawnedThisWave;
-    bool bossSpawned;
+    GameWorld world;
+    Replay replay;
+    string replayPath;
+    InputSampler inputSampler;
+    InputSample pendingInput;
+    LatencyHistogram inputLatency;
 
-    vector<CircleShape> playerBullets;
-    vector<CircleShape> enemyBullets;
+    unique_ptr<SpectatorBroadcaster> broadcaster;
+    unique_ptr<SpectatorClient> spectator;
 
-    vector<PowerUp> powerUps;
-    float powerUpSpawnTimer;
+    FlightRecorder flightRecorder;
+    uint32_t frameIndex;
+    double lastFrameStart;
+    double lastSpikeDump;
+    uint64_t recordedSpawns;
+    uint64_t recordedKills;
+    uint64_t recordedPlayerHits;
 
-    vector<unique_ptr<ParticleSystem>> particleSystems;
+    vector<ParticleSystem> particleSystems;
+    size_t nextParticleSystem;
+    size_t activeParticleSystems;
 
     Clock gameClock;
     float deltaTime;
 
+    FramePacer pacer;
+    FrameBudgetGovernor governor;
+    bool showStats;
+
+    AllocationCounters frameAllocations;
+    bool strictAllocations;
+    int steadyFrames;
+    double lastAllocationReport;
+
     RectangleShape background;
     vector<RectangleShape> stars;
+    View camera;
+    RenderFrontEnd frontEnd;
 
     Font font;
     bool fontLoaded;
+    Text scoreText;
+    Text healthText;
+    Text waveText;
+    Text controlsText;
+    int shownScore;
+    int shownHealth;
+    int shownWave;
 
 public:
-    SpaceShooterGame() : window(VideoMode(WINDOW_WIDTH, WINDOW_HEIGHT), "Space Shooter - Proje 13"),
-        currentState(MENU), enemySpawnTimer(0), enemySpawnInterval(1.0f),
-        waveNumber(1), enemiesPerWave(5), enemiesSpawnedThisWave(0),
-        bossSpawned(false), powerUpSpawnTimer(10.0f), deltaTime(0),
-        fontLoaded(false) {
-        window.setFramerateLimit(60);
-        srand(static_cast<unsigned>(time(nullptr)));
+    SpaceShooterGame(const LaunchOptions& options = LaunchOptions())
+        : window(VideoMode(WINDOW_WIDTH, WINDOW_HEIGHT), "Space Shooter - Proje 13"),
+        canvas(&window), fixedTimestep(false), currentState(MENU), replayPath(options.replayPath),
+        flightRecorder(options.flightSeconds, options.flightSpikeMs / 1000, options.flightDirectory), frameIndex(0),
+        lastFrameStart(0), lastSpikeDump(0), recordedSpawns(0), recordedKills(0), recordedPlayerHits(0),
+        particleSystems(MAX_PARTICLE_SYSTEMS), nextParticleSystem(0),
+        activeParticleSystems(0), deltaTime(0), pacer(options.targetFrameRate),
+        governor(pacer.getBudget()), showStats(false), frameAllocations(AllocationCounters()),
+        strictAllocations(options.strictAllocations), steadyFrames(0), lastAllocationReport(0),
+        fontLoaded(false), shownScore(INT_MIN), shownHealth(INT_MIN), shownWave(INT_MIN) {
+        if (options.refreshRate > 0) {
+            window.setVerticalSyncEnabled(true);
+            pacer.setTargetRate(options.refreshRate);
+            pacer.setRefreshRate(options.refreshRate);
+            governor.setBudget(pacer.getBudget());
+        }
+        srand(options.seed ? options.seed : static_cast<unsigned>(time(nullptr)));
+
+        if (!options.captureDirectory.empty()) {
+            setupCapture(options);
+        }
+        if (options.spectatePort) {
+            setupSpectator(options.spectatePort);
+        }
+        else if (options.broadcastPort) {
+            setupBroadcast(options.broadcastPort);
+        }
 
         setupBackground();
+        setupShapes();
         setupFont();
+        setupHud();
+        installFlightRecorderCrashHandler(&flightRecorder);
+    }
+
+    ~SpaceShooterGame() {
+        crashFlightRecorder = nullptr;
     }
 
 private:
@@ -464,132 +5385,127 @@ private:
         }
     }
 
-    void setupFont() {
-        fontLoaded = font.loadFromFile("C:\\Windows\\Fonts\\arial.ttf");
-        if (!fontLoaded) {
-            cout << "Font yuklenemedi! Textler gorunmeyebilir." << endl;
+    void setupCapture(const LaunchOptions& options) {
+        error_code error;
+        filesystem::create_directories(options.captureDirectory, error);
+        if (error || !captureTexture.create(WINDOW_WIDTH, WINDOW_HEIGHT)) {
+            cout << "Capture disabled: cannot prepare " << options.captureDirectory << endl;
+            return;
         }
+
+        unsigned workerCount = max(2u, thread::hardware_concurrency() / 2);
+        capture = make_unique<FrameCapture>(WINDOW_WIDTH, WINDOW_HEIGHT, options.captureDirectory,
+            options.captureFormat, options.captureLossless, workerCount);
+        fixedTimestep = options.captureLossless;
+        canvas = &captureTexture;
     }
 
-    void spawnEnemy() {
-        if (enemiesSpawnedThisWave < enemiesPerWave) {
-            enemies.push_back(EnemyShip(false));
-            enemiesSpawnedThisWave++;
-        }
-        else if (!bossSpawned && waveNumber % 3 == 0) {
-            enemies.push_back(EnemyShip(true));
-            bossSpawned = true;
+    void setupBroadcast(unsigned short port) {
+        broadcaster = make_unique<SpectatorBroadcaster>();
+        if (!broadcaster->listen(port)) {
+            cout << "Broadcast disabled: cannot bind port " << port << endl;
+            broadcaster.reset();
+            return;
         }
+        cout << "Broadcasting to spectators on 127.0.0.1:" << port << endl;
     }
 
-    void spawnPowerUp(Vector2f position) {
-        if (rand() % 100 < 10) {
-            powerUps.push_back(PowerUp(position));
+    void setupSpectator(unsigned short port) {
+        spectator = make_unique<SpectatorClient>();
+        if (!spectator->connect(IpAddress::LocalHost, port)) {
+            cout << "Spectator disabled: cannot open a local socket" << endl;
+            spectator.reset();
+            return;
         }
+        window.setTitle("Space Shooter - Spectator");
+        world.setStateHashing(false);
     }
 
-    void checkCollisions() {
-        for (size_t i = 0; i < playerBullets.size(); ++i) {
-            for (size_t j = 0; j < enemies.size(); ++j) {
-                if (enemies[j].isAlive()) {
-                    Vector2f bulletPos = playerBullets[i].getPosition();
-                    Vector2f enemyPos = enemies[j].getPosition();
-                    float enemyRadius = enemies[j].getRadius();
-
-                    float dx = bulletPos.x - enemyPos.x;
-                    float dy = bulletPos.y - enemyPos.y;
-                    float distance = sqrt(dx * dx + dy * dy);
-
-                    if (distance < enemyRadius + 5) {
-                        enemies[j].takeDamage(25);
-
-                        auto ps = make_unique<ParticleSystem>();
-                        ps->setEmitter(bulletPos);
-                        ps->startEmission();
-                        particleSystems.push_back(move(ps));
-
-                        if (!enemies[j].isAlive()) {
-                            player.addScore(enemies[j].getPoints());
-                            spawnPowerUp(enemies[j].getPosition());
-
-                            for (int k = 0; k < 3; ++k) {
-                                auto ps2 = make_unique<ParticleSystem>();
-                                ps2->setEmitter(enemies[j].getPosition());
-                                ps2->startEmission();
-                                particleSystems.push_back(move(ps2));
-                            }
-                        }
-
-                        playerBullets.erase(playerBullets.begin() + i);
-                        i--;
-                        break;
-                    }
-                }
-            }
-        }
+    void setupShapes() {
+        camera.setSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+    }
 
-        for (size_t i = 0; i < enemyBullets.size(); ++i) {
-            FloatRect playerBounds = player.getShape().getGlobalBounds();
-            FloatRect bulletBounds = enemyBullets[i].getGlobalBounds();
+    void setupHud() {
+        scoreText.setFont(font);
+        scoreText.setCharacterSize(24);
+        scoreText.setFillColor(Color::White);
+        scoreText.setPosition(20, 20);
 
-            if (playerBounds.intersects(bulletBounds)) {
-                player.takeDamage(10);
-                enemyBullets.erase(enemyBullets.begin() + i);
-                i--;
+        healthText.setFont(font);
+        healthText.setCharacterSize(24);
+        healthText.setFillColor(Color::Green);
+        healthText.setPosition(20, 50);
 
-                auto ps = make_unique<ParticleSystem>();
-                ps->setEmitter(player.getPosition());
-                ps->startEmission();
-                particleSystems.push_back(move(ps));
-            }
-        }
+        waveText.setFont(font);
+        waveText.setCharacterSize(24);
+        waveText.setFillColor(Color::Cyan);
+        waveText.setPosition(20, 80);
 
-        if (player.getIsAlive()) {
-            FloatRect playerBounds = player.getShape().getGlobalBounds();
+        controlsText.setFont(font);
+        controlsText.setString("Controls: WASD/Arrows = Move, SPACE = Shoot, P = Pause");
+        controlsText.setCharacterSize(18);
+        controlsText.setFillColor(Color(200, 200, 200));
+        controlsText.setPosition(20, WINDOW_HEIGHT - 40);
+    }
 
-            for (size_t i = 0; i < enemies.size(); ++i) {
-                if (enemies[i].isAlive()) {
-                    CircleShape enemyShape = enemies[i].getShape();
-                    FloatRect enemyBounds = enemyShape.getGlobalBounds();
-
-                    if (playerBounds.intersects(enemyBounds)) {
-                        player.takeDamage(enemies[i].getDamage());
-                        enemies[i].takeDamage(100);
-
-                        for (int j = 0; j < 5; ++j) {
-                            auto ps = make_unique<ParticleSystem>();
-                            ps->setEmitter(enemies[i].getPosition());
-                            ps->startEmission();
-                            particleSystems.push_back(move(ps));
-                        }
-                    }
-                }
-            }
+    static void setCounterText(Text& text, const char* label, int value, int& shownValue) {
+        if (value == shownValue) return;
+        shownValue = value;
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%s%d", label, value);
+        text.setString(buffer);
+    }
+
+    void setupFont() {
+        fontLoaded = font.loadFromFile("C:\\Windows\\Fonts\\arial.ttf");
+        if (!fontLoaded) {
+            cout << "Font yuklenemedi! Textler gorunmeyebilir." << endl;
         }
+    }
 
-        for (size_t i = 0; i < powerUps.size(); ++i) {
-            FloatRect playerBounds = player.getShape().getGlobalBounds();
-            FloatRect powerUpBounds = powerUps[i].getShape().getGlobalBounds();
+    void spawnParticles(Vector2f position, int bursts) {
+        const QualitySettings& quality = governor.getSettings();
+        int scaledBursts = max(1, static_cast<int>(bursts * quality.effectScale + 0.5f));
+        for (int i = 0; i < scaledBursts; ++i) {
+            ParticleSystem& ps = particleSystems[nextParticleSystem];
+            ps.setEmissionRate(quality.particleEmissionRate);
+            ps.setParticleCap(quality.particleCap);
+            ps.restart(position);
+            nextParticleSystem = (nextParticleSystem + 1) % MAX_PARTICLE_SYSTEMS;
+            activeParticleSystems = min(activeParticleSystems + 1, MAX_PARTICLE_SYSTEMS);
+        }
+    }
+
+    ParticleSystem& particleSystemByAge(size_t age) {
+        return particleSystems[(nextParticleSystem + MAX_PARTICLE_SYSTEMS - 1 - age) % MAX_PARTICLE_SYSTEMS];
+    }
+
+    void updateParticleSystems(float dt) {
+        for (size_t age = 0; age < activeParticleSystems; ++age) {
+            particleSystemByAge(age).update(dt);
+        }
+    }
 
-            if (playerBounds.intersects(powerUpBounds)) {
-                powerUps[i].applyEffect(player);
-                powerUps.erase(powerUps.begin() + i);
-                i--;
+    void cycleFrameRate() {
+        static const unsigned rates[] = { 60, 120, 144, 0 };
+        const size_t rateCount = sizeof(rates) / sizeof(rates[0]);
 
-                auto ps = make_unique<ParticleSystem>();
-                ps->setEmitter(player.getPosition());
-                ps->startEmission();
-                particleSystems.push_back(move(ps));
+        size_t next = 0;
+        for (size_t i = 0; i < rateCount; ++i) {
+            if (rates[i] == pacer.getTargetRate()) {
+                next = (i + 1) % rateCount;
             }
         }
+        pacer.setTargetRate(rates[next]);
+        governor.setBudget(pacer.getBudget());
     }
 
-    void nextWave() {
-        waveNumber++;
-        enemiesPerWave += 2;
-        enemiesSpawnedThisWave = 0;
-        bossSpawned = false;
-        enemySpawnInterval = max(0.3f, 1.0f - waveNumber * 0.05f);
+    void applyQuality() {
+        const QualitySettings& quality = governor.getSettings();
+        for (auto& ps : particleSystems) {
+            ps.setEmissionRate(quality.particleEmissionRate);
+            ps.setParticleCap(quality.particleCap);
+        }
     }
 
     void handleInput() {
@@ -599,6 +5515,28 @@ private:
                 window.close();
             }
 
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::F3) {
+                showStats = !showStats;
+                continue;
+            }
+
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::F4) {
+                cycleFrameRate();
+                continue;
+            }
+
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::F5) {
+                flightRecorder.dump(FLIGHT_HOTKEY);
+                continue;
+            }
+
+            if (event.type == Event::KeyPressed && spectator) {
+                if (event.key.code == Keyboard::Escape) {
+                    window.close();
+                }
+                continue;
+            }
+
             if (event.type == Event::KeyPressed) {
                 switch (currentState) {
                 case MENU:
@@ -615,12 +5553,6 @@ private:
                     if (event.key.code == Keyboard::P) {
                         currentState = PAUSED;
                     }
-                    else if (event.key.code == Keyboard::Space) {
-                        if (player.canShoot()) {
-                            playerBullets.push_back(player.createBullet());
-                            player.shoot();
-                        }
-                    }
                     break;
 
                 case GAME_OVER:
@@ -638,33 +5570,23 @@ private:
             }
         }
 
-        if (currentState == PLAYING && player.getIsAlive()) {
-            if (Keyboard::isKeyPressed(Keyboard::Space) && player.canShoot()) {
-                playerBullets.push_back(player.createBullet());
-                player.shoot();
-            }
-        }
     }
 
     void resetGame() {
-        player = PlayerShip();
-        enemies.clear();
-        playerBullets.clear();
-        enemyBullets.clear();
-        powerUps.clear();
-        particleSystems.clear();
-
-        waveNumber = 1;
-        enemiesPerWave = 5;
-        enemiesSpawnedThisWave = 0;
-        bossSpawned = false;
-        enemySpawnInterval = 1.0f;
-        enemySpawnTimer = 0;
-        powerUpSpawnTimer = 10.0f;
+        uint32_t seed = static_cast<uint32_t>(rand());
+        world.reset(seed);
+        if (!replayPath.empty()) {
+            replay.begin(seed, REPLAY_RESERVED_FRAMES);
+        }
+        activeParticleSystems = 0;
     }
 
     void update(float dt) {
         deltaTime = dt;
+        if (spectator) {
+            updateSpectator(dt);
+            return;
+        }
 
         switch (currentState) {
         case PLAYING:
@@ -680,99 +5602,71 @@ private:
             updateMenu(dt);
             break;
         }
-    }
-
-    void updateGameplay(float dt) {
-        player.update(dt);
-
-        enemySpawnTimer += dt;
-        if (enemySpawnTimer >= enemySpawnInterval) {
-            spawnEnemy();
-            enemySpawnTimer = 0;
-        }
-
-        powerUpSpawnTimer += dt;
-        if (powerUpSpawnTimer >= 15.0f) {
-            Vector2f spawnPos(rand() % (WINDOW_WIDTH - 100) + 50, -50);
-            powerUps.push_back(PowerUp(spawnPos));
-            powerUpSpawnTimer = 0;
-        }
-
-        for (size_t i = 0; i < enemies.size();) {
-            enemies[i].update(dt);
-
-            if (enemies[i].canShoot() && enemies[i].isAlive()) {
-                enemyBullets.push_back(enemies[i].createBullet());
-                enemies[i].resetShootTimer();
-            }
-
-            if (enemies[i].isOffScreen() || !enemies[i].isAlive()) {
-                enemies.erase(enemies.begin() + i);
-            }
-            else {
-                ++i;
-            }
-        }
-
-        if (enemiesSpawnedThisWave >= enemiesPerWave && enemies.empty()) {
-            nextWave();
-        }
-
-        for (size_t i = 0; i < playerBullets.size();) {
-            playerBullets[i].move(0, -800 * dt);
-            if (playerBullets[i].getPosition().y < -10) {
-                playerBullets.erase(playerBullets.begin() + i);
-            }
-            else {
-                ++i;
-            }
-        }
-
-        for (size_t i = 0; i < enemyBullets.size();) {
-            enemyBullets[i].move(0, 400 * dt);
-            if (enemyBullets[i].getPosition().y > WINDOW_HEIGHT + 10) {
-                enemyBullets.erase(enemyBullets.begin() + i);
-            }
-            else {
-                ++i;
-            }
+    }
+
+    void updateGameplay(float dt) {
+        world.step(dt, pendingInput.input);
+        if (!replayPath.empty()) {
+            replay.record(dt, pendingInput.input, world.getStateHash());
         }
+        broadcastWorld();
 
-        for (size_t i = 0; i < powerUps.size();) {
-            powerUps[i].update(dt);
-            if (powerUps[i].isOffScreen()) {
-                powerUps.erase(powerUps.begin() + i);
-            }
-            else {
-                ++i;
-            }
+        for (const auto& effect : world.getEffects()) {
+            spawnParticles(effect.position, effect.bursts);
         }
+        world.clearEffects();
 
-        for (size_t i = 0; i < particleSystems.size();) {
-            particleSystems[i]->update(dt);
+        activeParticleSystems = min(activeParticleSystems, governor.getSettings().maxParticleSystems);
+        updateParticleSystems(dt);
 
-            if (i > 10) {
-                particleSystems.erase(particleSystems.begin());
-            }
-            else {
-                ++i;
-            }
+        if (world.isGameOver()) {
+            currentState = GAME_OVER;
+            saveReplay();
         }
+    }
 
-        checkCollisions();
+    void saveReplay() {
+        if (replayPath.empty() || replay.isEmpty()) return;
 
-        if (!player.getIsAlive()) {
-            currentState = GAME_OVER;
+        AllocationPhaseScope phase(PHASE_INSTRUMENTATION);
+        if (replay.save(replayPath)) {
+            cout << "Replay saved: " << replayPath << " (" << replay.getFrameCount() << " ticks)" << endl;
+        }
+        else {
+            cout << "Replay could not be written: " << replayPath << endl;
         }
     }
 
     void updateGameOver(float dt) {
-        for (auto& ps : particleSystems) {
-            ps->update(dt);
-        }
+        broadcastWorld();
+        updateParticleSystems(dt);
     }
 
     void updatePaused(float dt) {
+        broadcastWorld();
+    }
+
+    void broadcastWorld() {
+        if (broadcaster) {
+            broadcaster->broadcast(world, currentState);
+        }
+    }
+
+    void updateSpectator(float dt) {
+        if (spectator->poll(monotonicSeconds())) {
+            const SpectatorSnapshot& snapshot = spectator->getLatest();
+            world.applySnapshot(snapshot);
+            int state = snapshot.globals[SPECTATOR_STATE];
+            currentState = state == PAUSED || state == GAME_OVER ? static_cast<GameState>(state) : PLAYING;
+        }
+
+        for (const auto& effect : spectator->getEffects()) {
+            spawnParticles(effect.position, effect.bursts);
+        }
+        spectator->clearEffects();
+
+        activeParticleSystems = min(activeParticleSystems, governor.getSettings().maxParticleSystems);
+        updateParticleSystems(dt);
     }
 
     void updateMenu(float dt) {
@@ -785,17 +5679,23 @@ private:
     }
 
     void render() {
-        window.clear();
+        canvas->clear();
 
-        window.draw(background);
+        canvas->draw(background);
 
-        for (const auto& star : stars) {
-            window.draw(star);
+        size_t starCount = min(stars.size(), governor.getSettings().starCount);
+        for (size_t i = 0; i < starCount; ++i) {
+            canvas->draw(stars[i]);
         }
 
         switch (currentState) {
         case MENU:
-            renderMenu();
+            if (spectator) {
+                renderSpectatorWaiting();
+            }
+            else {
+                renderMenu();
+            }
             break;
 
         case PLAYING:
@@ -815,7 +5715,171 @@ private:
             break;
         }
 
-        window.display();
+        if (showStats) {
+            renderStats();
+        }
+
+        if (capture) {
+            captureTexture.display();
+            capture->captureFrom(captureTexture);
+            window.clear();
+            window.draw(Sprite(captureTexture.getTexture()));
+        }
+    }
+
+    static uint16_t flightCount(uint64_t count) {
+        return static_cast<uint16_t>(min<uint64_t>(count, UINT16_MAX));
+    }
+
+    void recordFlight(double frameStart, float workTime, float tickTime, float renderTime) {
+        float interval = lastFrameStart > 0 ? static_cast<float>(frameStart - lastFrameStart) : 0;
+        lastFrameStart = frameStart;
+
+        size_t particles = 0;
+        for (size_t age = 0; age < activeParticleSystems; ++age) {
+            particles += particleSystemByAge(age).getParticleCount();
+        }
+        uint64_t playerHits = world.getCommands().getTotalCount(COMMAND_DAMAGE_PLAYER);
+
+        FlightRecord& record = flightRecorder.next();
+        record.time = frameStart;
+        record.frame = frameIndex++;
+        record.interval = interval;
+        record.workTime = workTime;
+        record.tickTime = tickTime;
+        record.renderTime = renderTime;
+        record.allocations = static_cast<uint32_t>(frameAllocations.totalAllocations(false));
+        record.enemies = flightCount(world.getEnemies().size());
+        record.playerBullets = flightCount(world.getPlayerBullets().size());
+        record.enemyBullets = flightCount(world.getEnemyBullets().size());
+        record.missiles = flightCount(world.getPlayerMissiles().size());
+        record.powerUps = flightCount(world.getPowerUps().size());
+        record.particles = flightCount(particles);
+        record.spawned = flightCount(world.getSpawnedEnemyCount() - recordedSpawns);
+        record.killed = flightCount(world.getKilledEnemyCount() - recordedKills);
+        record.playerHits = flightCount(playerHits - recordedPlayerHits);
+        record.moveX = static_cast<int8_t>(pendingInput.input.moveX * 100);
+        record.moveY = static_cast<int8_t>(pendingInput.input.moveY * 100);
+        record.fire = pendingInput.input.fire;
+        record.state = static_cast<uint8_t>(currentState);
+        record.quality = static_cast<uint8_t>(governor.getLevel());
+        record.reserved = 0;
+        recordedSpawns = world.getSpawnedEnemyCount();
+        recordedKills = world.getKilledEnemyCount();
+        recordedPlayerHits = playerHits;
+
+        if (flightRecorder.isSpike(interval) && frameIndex > STEADY_STATE_FRAMES &&
+            frameStart - lastSpikeDump > SPIKE_DUMP_COOLDOWN) {
+            lastSpikeDump = frameStart;
+            flightRecorder.dump(FLIGHT_SPIKE);
+        }
+    }
+
+    void checkSteadyStateAllocations() {
+        steadyFrames = currentState == PLAYING ? steadyFrames + 1 : 0;
+        if (!strictAllocations || steadyFrames < STEADY_STATE_FRAMES) return;
+        if (frameAllocations.totalAllocations(false) == 0) return;
+
+        double now = monotonicSeconds();
+        if (now - lastAllocationReport < 1.0) return;
+        lastAllocationReport = now;
+
+        cout << "Steady-state allocation: " << frameAllocations.totalAllocations(false) << " allocations, "
+            << frameAllocations.totalBytes(false) << " bytes (";
+        for (int i = 0; i < PHASE_COUNT; ++i) {
+            if (i == PHASE_INSTRUMENTATION || frameAllocations.allocations[i] == 0) continue;
+            cout << " " << AllocationTracker::phaseName(i) << "=" << frameAllocations.allocations[i];
+        }
+        cout << " )" << endl;
+    }
+
+    void renderStats() {
+        if (!fontLoaded) return;
+
+        AllocationPhaseScope phase(PHASE_INSTRUMENTATION);
+
+        const FrameBudgetGovernor::Decision& decision = governor.getLastDecision();
+        ostringstream stats;
+        stats.precision(2);
+        stats << fixed
+            << "Frame: " << governor.getSmoothedFrameTime() * 1000 << " ms / "
+            << governor.getBudget() * 1000 << " ms budget\n"
+            << "Tick: " << governor.getSmoothedTickTime() * 1000 << " ms\n"
+            << "Quality: " << governor.getLevel() << "/" << FrameBudgetGovernor::LEVEL_COUNT - 1
+            << " (particles " << governor.getSettings().particleEmissionRate << "/update, cap "
+            << governor.getSettings().particleCap << ", stars " << governor.getSettings().starCount << ")\n"
+            << "Particle systems: " << activeParticleSystems << "\n"
+            << "Allocations last frame: " << frameAllocations.totalAllocations(false) << " ("
+            << frameAllocations.totalBytes(false) << " bytes; update " << frameAllocations.allocations[PHASE_UPDATE]
+            << ", render " << frameAllocations.allocations[PHASE_RENDER] << ", input "
+            << frameAllocations.allocations[PHASE_INPUT] << ")\n"
+            << "Pacing: " << (pacer.getTargetRate() ? to_string(pacer.getTargetRate()) : string("unlimited"))
+            << (!pacer.isAlignedToRefresh() ? " fps" : pacer.pacesFrames() ? " fps, refresh aligned" : " fps, vsync paced")
+            << ", jitter p99 "
+            << pacer.getJitter().percentile(0.99f) * 1000 << " ms, max " << pacer.getJitter().getMax() * 1000 << " ms\n"
+            << "Input to present: p50 " << inputLatency.percentile(0.5f) * 1000 << " ms, p99 "
+            << inputLatency.percentile(0.99f) * 1000 << " ms (" << inputLatency.getCount() << ")\n"
+            << "World: camera " << world.getCameraTop() << " / " << LEVEL_HEIGHT << ", chunks streamed "
+            << world.getActiveChunkCount() << "/" << LEVEL_CHUNKS << ", enemies " << world.getEnemies().size()
+            << ", narrowphase " << simdLevelName(world.getNarrowphaseLevel()) << "\n"
+            << "Scripts: " << world.getScripts().getLiveScripts() << " live, " << world.getScripts().getResumeCount()
+            << " resumes\n"
+            << "AI: " << world.getAiScheduler().getLastThinks() << " thinks, cost "
+            << world.getAiScheduler().getLastCost() << "/" << world.getAiScheduler().getBudget() << ", deferred "
+            << world.getAiScheduler().getLastDeferred() << ", " << world.getAiScheduler().getLastSeconds() * 1000 << " ms\n"
+            << "Status effects: " << world.getStatusEffects().getActiveCount() << " active, "
+            << world.getStatusEffects().getLastExpired() << " expired last tick";
+        for (int type = 0; type < STATUS_EFFECT_COUNT; ++type) {
+            float remaining = world.getStatusEffects().getRemaining(static_cast<StatusEffectType>(type));
+            if (remaining > 0) {
+                stats << ", " << StatusEffects::typeName(type) << " " << remaining << " s";
+            }
+        }
+        stats << "\n"
+            << "Render build: " << frontEnd.getBuildSeconds() * 1000 << " ms on "
+            << (frontEnd.wasLastBuildParallel() ? frontEnd.getThreadCount() : 1) << " threads (";
+        for (int layer = 0; layer < RENDER_LAYER_COUNT; ++layer) {
+            stats << (layer ? ", " : "") << RenderFrontEnd::layerName(layer) << " "
+                << frontEnd.getLayerSeconds(layer) * 1000 << " ms/" << frontEnd.getVertexCount(layer) << "v";
+        }
+        stats << ")\n"
+            << "State: tick " << world.getTickCount() << ", hash " << hex << world.getStateHash() << dec << "\n"
+            << "Commands:";
+        for (int type = 0; type < COMMAND_TYPE_COUNT; type++) {
+            stats << " " << CommandBuffer::typeName(type) << " " << world.getCommands().getLastCount(type);
+        }
+        stats << "\n";
+        if (broadcaster) {
+            stats << "Broadcast: " << broadcaster->getViewerCount() << " viewers, " << broadcaster->getLastBytes()
+                << " bytes/tick, " << broadcaster->getLastEncodings() << " encodings, encode "
+                << broadcaster->getLastEncodeSeconds() * 1e6 << " us, send " << broadcaster->getLastSendSeconds() * 1e6 << " us, dropped "
+                << broadcaster->getDroppedPackets() << ", fragmented " << broadcaster->getFragmentedPackets() << ", oversize "
+                << broadcaster->getOversizePackets() << "\n";
+        }
+        if (spectator) {
+            stats << "Spectating: " << spectator->getReceivedPackets() << " snapshots, " << spectator->getLastBytes()
+                << " bytes last frame, decode " << spectator->getLastDecodeSeconds() * 1e6 << " us, dropped "
+                << spectator->getDroppedPackets() << "\n";
+        }
+        if (capture) {
+            stats << "Capture: " << capture->getWrittenFrames() << " written, " << capture->getDroppedFrames()
+                << " dropped, " << capture->getStalledFrames() << " stalled (last " << capture->getLastWaitSeconds() * 1000
+                << " ms, max " << capture->getMaxWaitSeconds() * 1000 << " ms), queue " << capture->getQueueDepth() << " (max "
+                << capture->getMaxQueueDepth() << "), encode " << capture->getAverageEncodeTime() * 1000 << " ms\n";
+        }
+        if (governor.hasLastDecision()) {
+            stats << "Last change: " << decision.fromLevel << " -> " << decision.toLevel
+                << " at " << decision.frameTime * 1000 << " ms frame, " << decision.tickTime * 1000 << " ms tick, "
+                << monotonicSeconds() - decision.timestamp << " s ago\n";
+        }
+
+        Text statsText;
+        statsText.setFont(font);
+        statsText.setString(stats.str());
+        statsText.setCharacterSize(16);
+        statsText.setFillColor(Color::Yellow);
+        statsText.setPosition(20, 120);
+        canvas->draw(statsText);
     }
 
     void renderMenu() {
@@ -825,7 +5889,7 @@ private:
         titleBox.setOutlineThickness(3);
         titleBox.setOrigin(300, 150);
         titleBox.setPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2);
-        window.draw(titleBox);
+        canvas->draw(titleBox);
 
         if (fontLoaded) {
             Text titleText;
@@ -837,7 +5901,7 @@ private:
             FloatRect titleBounds = titleText.getLocalBounds();
             titleText.setOrigin(titleBounds.width / 2, titleBounds.height / 2);
             titleText.setPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2 - 80);
-            window.draw(titleText);
+            canvas->draw(titleText);
 
             Text startText;
             startText.setFont(font);
@@ -847,7 +5911,7 @@ private:
             FloatRect startBounds = startText.getLocalBounds();
             startText.setOrigin(startBounds.width / 2, startBounds.height / 2);
             startText.setPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2);
-            window.draw(startText);
+            canvas->draw(startText);
 
             Text exitText;
             exitText.setFont(font);
@@ -857,7 +5921,7 @@ private:
             FloatRect exitBounds = exitText.getLocalBounds();
             exitText.setOrigin(exitBounds.width / 2, exitBounds.height / 2);
             exitText.setPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2 + 50);
-            window.draw(exitText);
+            canvas->draw(exitText);
         }
         else {
             RectangleShape startButton(Vector2f(300, 50));
@@ -866,7 +5930,7 @@ private:
             startButton.setOutlineThickness(2);
             startButton.setOrigin(150, 25);
             startButton.setPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2);
-            window.draw(startButton);
+            canvas->draw(startButton);
 
             RectangleShape exitButton(Vector2f(300, 50));
             exitButton.setFillColor(Color::Red);
@@ -874,7 +5938,7 @@ private:
             exitButton.setOutlineThickness(2);
             exitButton.setOrigin(150, 25);
             exitButton.setPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2 + 70);
-            window.draw(exitButton);
+            canvas->draw(exitButton);
         }
 
         if (fontLoaded) {
@@ -884,125 +5948,58 @@ private:
             controlsText.setCharacterSize(20);
             controlsText.setFillColor(Color::White);
             controlsText.setPosition(20, WINDOW_HEIGHT - 40);
-            window.draw(controlsText);
+            canvas->draw(controlsText);
         }
     }
 
-    void renderGame() {
-        if (player.getIsAlive()) {
-            window.draw(player.getShape());
-        }
-
-        for (const auto& enemy : enemies) {
-            if (enemy.isAlive()) {
-                window.draw(enemy.getShape());
-
-                if (enemy.getIsBoss()) {
-                    RectangleShape healthBar(Vector2f(100, 10));
-                    healthBar.setFillColor(Color::Red);
-                    healthBar.setOutlineColor(Color::White);
-                    healthBar.setOutlineThickness(1);
-                    healthBar.setPosition(enemy.getPosition().x - 50,
-                        enemy.getPosition().y - 60);
-
-                    float healthPercent = static_cast<float>(enemy.getHealth()) / enemy.getMaxHealth();
-                    RectangleShape healthFill(Vector2f(100 * healthPercent, 10));
-                    healthFill.setFillColor(Color::Green);
-                    healthFill.setPosition(enemy.getPosition().x - 50,
-                        enemy.getPosition().y - 60);
-
-                    window.draw(healthBar);
-                    window.draw(healthFill);
-                }
-            }
-        }
-
-        for (const auto& bullet : playerBullets) {
-            window.draw(bullet);
-        }
-        for (const auto& bullet : enemyBullets) {
-            window.draw(bullet);
-        }
-
-        for (const auto& powerUp : powerUps) {
-            window.draw(powerUp.getShape());
-        }
-
-        for (const auto& ps : particleSystems) {
-            window.draw(*ps);
-        }
-
-        if (player.getIsAlive()) {
-            RectangleShape playerHealthBar(Vector2f(200, 15));
-            playerHealthBar.setFillColor(Color::Black);
-            playerHealthBar.setOutlineColor(Color::White);
-            playerHealthBar.setOutlineThickness(1);
-            playerHealthBar.setPosition(WINDOW_WIDTH - 220, 20);
+    void renderSpectatorWaiting() {
+        if (!fontLoaded) return;
 
-            float playerHealthPercent = player.getHealth() / 100.f;
-            RectangleShape playerHealthFill(Vector2f(200 * playerHealthPercent, 15));
-            playerHealthFill.setFillColor(Color::Green);
-            playerHealthFill.setPosition(WINDOW_WIDTH - 220, 20);
+        Text waitingText;
+        waitingText.setFont(font);
+        waitingText.setString("Waiting for broadcast on port " + to_string(spectator->getServerPort()) + "...");
+        waitingText.setCharacterSize(32);
+        waitingText.setFillColor(Color::Cyan);
+        FloatRect waitingBounds = waitingText.getLocalBounds();
+        waitingText.setOrigin(waitingBounds.width / 2, waitingBounds.height / 2);
+        waitingText.setPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2);
+        canvas->draw(waitingText);
+    }
 
-            window.draw(playerHealthBar);
-            window.draw(playerHealthFill);
+    void renderGame() {
+        const ParticleSystem* systems[MAX_PARTICLE_SYSTEMS];
+        for (size_t age = 0; age < activeParticleSystems; ++age) {
+            systems[age] = &particleSystemByAge(age);
         }
+        frontEnd.build(world, systems, activeParticleSystems);
 
-        RectangleShape cooldownBar(Vector2f(200, 10));
-        cooldownBar.setFillColor(Color::Black);
-        cooldownBar.setOutlineColor(Color::White);
-        cooldownBar.setOutlineThickness(1);
-        cooldownBar.setPosition(WINDOW_WIDTH - 220, 45);
-
-        float cooldownPercent = player.getShootCooldown() / player.getMaxShootCooldown();
-        RectangleShape cooldownFill(Vector2f(200 * (1 - cooldownPercent), 10));
-        cooldownFill.setFillColor(Color::Yellow);
-        cooldownFill.setPosition(WINDOW_WIDTH - 220, 45);
+        camera.setCenter(WINDOW_WIDTH / 2, world.getCameraTop() + WINDOW_HEIGHT / 2);
+        canvas->setView(camera);
+        frontEnd.submitWorld(*canvas);
 
-        window.draw(cooldownBar);
-        window.draw(cooldownFill);
+        canvas->setView(canvas->getDefaultView());
+        frontEnd.submitHud(*canvas);
     }
 
     void renderUI() {
         if (!fontLoaded) return;
 
-        Text scoreText;
-        scoreText.setFont(font);
-        scoreText.setString("Score: " + to_string(player.getScore()));
-        scoreText.setCharacterSize(24);
-        scoreText.setFillColor(Color::White);
-        scoreText.setPosition(20, 20);
-        window.draw(scoreText);
-
-        Text healthText;
-        healthText.setFont(font);
-        healthText.setString("Health: " + to_string(player.getHealth()));
-        healthText.setCharacterSize(24);
-        healthText.setFillColor(Color::Green);
-        healthText.setPosition(20, 50);
-        window.draw(healthText);
+        const PlayerShip& player = world.getPlayer();
 
-        Text waveText;
-        waveText.setFont(font);
-        waveText.setString("Wave: " + to_string(waveNumber));
-        waveText.setCharacterSize(24);
-        waveText.setFillColor(Color::Cyan);
-        waveText.setPosition(20, 80);
-        window.draw(waveText);
+        setCounterText(scoreText, "Score: ", player.getScore(), shownScore);
+        setCounterText(healthText, "Health: ", player.getHealth(), shownHealth);
+        setCounterText(waveText, "Wave: ", world.getWaveNumber(), shownWave);
 
-        Text controlsText;
-        controlsText.setFont(font);
-        controlsText.setString("Controls: WASD/Arrows = Move, SPACE = Shoot, P = Pause");
-        controlsText.setCharacterSize(18);
-        controlsText.setFillColor(Color(200, 200, 200));
-        controlsText.setPosition(20, WINDOW_HEIGHT - 40);
-        window.draw(controlsText);
+        canvas->draw(scoreText);
+        canvas->draw(healthText);
+        canvas->draw(waveText);
+        canvas->draw(controlsText);
     }
 
     void renderGameOver() {
         RectangleShape overlay(Vector2f(WINDOW_WIDTH, WINDOW_HEIGHT));
         overlay.setFillColor(Color(0, 0, 0, 150));
-        window.draw(overlay);
+        canvas->draw(overlay);
 
         if (!fontLoaded) return;
 
@@ -1015,17 +6012,17 @@ private:
         FloatRect gameOverBounds = gameOverText.getLocalBounds();
         gameOverText.setOrigin(gameOverBounds.width / 2, gameOverBounds.height / 2);
         gameOverText.setPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2 - 50);
-        window.draw(gameOverText);
+        canvas->draw(gameOverText);
 
         Text finalScore;
         finalScore.setFont(font);
-        finalScore.setString("Final Score: " + to_string(player.getScore()));
+        finalScore.setString("Final Score: " + to_string(world.getPlayer().getScore()));
         finalScore.setCharacterSize(36);
         finalScore.setFillColor(Color::White);
         FloatRect scoreBounds = finalScore.getLocalBounds();
         finalScore.setOrigin(scoreBounds.width / 2, scoreBounds.height / 2);
         finalScore.setPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2 + 30);
-        window.draw(finalScore);
+        canvas->draw(finalScore);
 
         Text restartText;
         restartText.setFont(font);
@@ -1035,13 +6032,13 @@ private:
         FloatRect restartBounds = restartText.getLocalBounds();
         restartText.setOrigin(restartBounds.width / 2, restartBounds.height / 2);
         restartText.setPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2 + 100);
-        window.draw(restartText);
+        canvas->draw(restartText);
     }
 
     void renderPaused() {
         RectangleShape overlay(Vector2f(WINDOW_WIDTH, WINDOW_HEIGHT));
         overlay.setFillColor(Color(0, 0, 0, 150));
-        window.draw(overlay);
+        canvas->draw(overlay);
 
         if (!fontLoaded) return;
 
@@ -1054,7 +6051,7 @@ private:
         FloatRect pauseBounds = pauseText.getLocalBounds();
         pauseText.setOrigin(pauseBounds.width / 2, pauseBounds.height / 2);
         pauseText.setPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2 - 50);
-        window.draw(pauseText);
+        canvas->draw(pauseText);
 
         Text resumeText;
         resumeText.setFont(font);
@@ -1064,7 +6061,7 @@ private:
         FloatRect resumeBounds = resumeText.getLocalBounds();
         resumeText.setOrigin(resumeBounds.width / 2, resumeBounds.height / 2);
         resumeText.setPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2 + 50);
-        window.draw(resumeText);
+        canvas->draw(resumeText);
     }
 
 public:
@@ -1073,18 +6070,612 @@ public:
         cout << "Kontroller: WASD/Ok Tuslari = Hareket, SPACE = Ates Et, P = Duraklat" << endl;
 
         while (window.isOpen()) {
-            float dt = gameClock.restart().asSeconds();
+            pacer.wait();
+            float dt = pacer.getTickDelta(gameClock.restart().asSeconds());
+            if (fixedTimestep) {
+                dt = pacer.getBudget();
+            }
+            double frameStart = monotonicSeconds();
+            AllocationCounters allocationsAtStart = AllocationTracker::snapshot();
 
+            AllocationTracker::setPhase(PHASE_INPUT);
             handleInput();
+            pendingInput = inputSampler.take();
+            double tickStart = monotonicSeconds();
+            AllocationTracker::setPhase(PHASE_UPDATE);
             update(dt);
+            double tickEnd = monotonicSeconds();
+            AllocationTracker::setPhase(PHASE_RENDER);
             render();
+            double frameEnd = monotonicSeconds();
+
+            AllocationTracker::setPhase(PHASE_PRESENT);
+            window.display();
+            AllocationTracker::setPhase(PHASE_OTHER);
+
+            if (pendingInput.changed && currentState == PLAYING) {
+                inputLatency.record(static_cast<float>(monotonicSeconds() - pendingInput.changeTime));
+            }
+
+            float captureWait = capture ? capture->getLastWaitSeconds() : 0;
+            if (governor.recordFrame(static_cast<float>(frameEnd - frameStart) - captureWait,
+                static_cast<float>(tickEnd - tickStart))) {
+                applyQuality();
+            }
+
+            frameAllocations = AllocationTracker::snapshot() - allocationsAtStart;
+            checkSteadyStateAllocations();
+            recordFlight(frameStart, static_cast<float>(frameEnd - frameStart), static_cast<float>(tickEnd - tickStart),
+                static_cast<float>(frameEnd - tickEnd));
+        }
+
+        if (currentState == PLAYING || currentState == PAUSED) {
+            saveReplay();
+        }
+
+        inputLatency.print(cout, "Input to present latency");
+        pacer.getJitter().print(cout, "Frame pacing jitter");
+
+        if (capture) {
+            capture->finish();
+            capture->printStats(cout);
+        }
+        if (broadcaster) {
+            broadcaster->printStats(cout);
         }
     }
 };
 
-int main() {
-    SpaceShooterGame game;
+void runEnvironmentBenchmark(size_t envCount, int steps) {
+    BatchedEnvironment env(envCount);
+    vector<float> observations(env.getEnvCount() * env.getObservationSize());
+    vector<int> actions(env.getEnvCount());
+    vector<float> rewards(env.getEnvCount());
+    vector<Uint8> dones(env.getEnvCount());
+    vector<int> scores(env.getEnvCount());
+    Random actionRng(12345);
+
+    env.reset(observations.data());
+
+    auto start = chrono::steady_clock::now();
+    for (int s = 0; s < steps; ++s) {
+        for (auto& action : actions) {
+            action = actionRng.nextInt(BatchedEnvironment::ACTION_COUNT);
+        }
+        env.step(actions.data(), observations.data(), rewards.data(), dones.data(), scores.data());
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << envCount << " envs x " << steps << " steps on " << env.getThreadCount() << " threads: "
+        << static_cast<double>(envCount) * steps / seconds << " steps/s" << endl;
+}
+
+template <int Archetype>
+size_t stepEnemyRange(EnemyShip* first, EnemyShip* last, float dt, const EnemyContext& context, Bullet* volley) {
+    size_t shots = 0;
+    for (EnemyShip* enemy = first; enemy != last; ++enemy) {
+        shots += stepEnemy<Archetype>(*enemy, dt, context, volley);
+    }
+    return shots;
+}
+
+void runEnemyBenchmark(size_t enemyCount, int steps) {
+    Random rng(4242);
+    vector<EnemyShip> mixed;
+    mixed.reserve(enemyCount);
+    for (size_t i = 0; i < enemyCount; ++i) {
+        mixed.push_back(spawnEnemyArchetype(static_cast<EnemyArchetypeId>(rng.nextInt(ENEMY_ARCHETYPE_COUNT)), rng));
+    }
+
+    vector<EnemyShip> grouped = mixed;
+    stable_sort(grouped.begin(), grouped.end(), [](const EnemyShip& a, const EnemyShip& b) {
+        return a.getArchetype() < b.getArchetype();
+    });
+    size_t bounds[ENEMY_ARCHETYPE_COUNT + 1] = { 0 };
+    for (const auto& enemy : grouped) {
+        bounds[enemy.getArchetype() + 1]++;
+    }
+    for (int i = 0; i < ENEMY_ARCHETYPE_COUNT; ++i) {
+        bounds[i + 1] += bounds[i];
+    }
+
+    const float dt = 1.0f / 60.f;
+    EnemyContext context(Vector2f(WINDOW_WIDTH / 2, WINDOW_HEIGHT - 100));
+    Bullet volley[MAX_ENEMY_VOLLEY];
+
+    size_t dispatchedShots = 0;
+    auto start = chrono::steady_clock::now();
+    for (int s = 0; s < steps; ++s) {
+        for (auto& enemy : mixed) {
+            dispatchedShots += stepEnemyDispatched(enemy, dt, context, volley);
+        }
+    }
+    double dispatchedSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    size_t groupedShots = 0;
+    EnemyShip* base = grouped.data();
+    start = chrono::steady_clock::now();
+    for (int s = 0; s < steps; ++s) {
+        groupedShots += stepEnemyRange<ENEMY_GRUNT>(base + bounds[0], base + bounds[1], dt, context, volley);
+        groupedShots += stepEnemyRange<ENEMY_SCOUT>(base + bounds[1], base + bounds[2], dt, context, volley);
+        groupedShots += stepEnemyRange<ENEMY_TANK>(base + bounds[2], base + bounds[3], dt, context, volley);
+        groupedShots += stepEnemyRange<ENEMY_KAMIKAZE>(base + bounds[3], base + bounds[4], dt, context, volley);
+        groupedShots += stepEnemyRange<ENEMY_SWARMER>(base + bounds[4], base + bounds[5], dt, context, volley);
+        groupedShots += stepEnemyRange<ENEMY_BOSS>(base + bounds[5], base + bounds[6], dt, context, volley);
+    }
+    double groupedSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    double updates = static_cast<double>(enemyCount) * steps;
+    cout << enemyCount << " mixed enemies x " << steps << " steps" << endl;
+    cout << "  per-enemy dispatch:  " << dispatchedSeconds * 1e9 / updates << " ns/update, "
+        << dispatchedShots << " shots" << endl;
+    cout << "  per-archetype loops: " << groupedSeconds * 1e9 / updates << " ns/update, "
+        << groupedShots << " shots" << endl;
+}
+
+void runSpatialBenchmark(size_t targetCount, size_t queryCount, int steps) {
+    Random rng(777);
+    vector<Vector2f> targets(targetCount);
+    vector<Vector2f> queries(queryCount);
+    for (auto& target : targets) {
+        target = Vector2f(rng.nextInt(WINDOW_WIDTH), rng.nextInt(WINDOW_HEIGHT));
+    }
+    for (auto& query : queries) {
+        query = Vector2f(rng.nextInt(WINDOW_WIDTH), rng.nextInt(WINDOW_HEIGHT));
+    }
+
+    SpatialGrid grid;
+    grid.reserve(targetCount);
+    vector<int32_t> gridNearest(queryCount);
+    vector<int32_t> bruteNearest(queryCount);
+
+    auto start = chrono::steady_clock::now();
+    for (int s = 0; s < steps; ++s) {
+        grid.rebuild(targetCount, [&targets](size_t i) { return targets[i]; });
+        grid.nearestBatch(queries.data(), queryCount, WINDOW_HEIGHT, gridNearest.data());
+    }
+    double gridSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    start = chrono::steady_clock::now();
+    for (int s = 0; s < steps; ++s) {
+        for (size_t q = 0; q < queryCount; ++q) {
+            float best = WINDOW_HEIGHT * WINDOW_HEIGHT;
+            bruteNearest[q] = -1;
+            for (size_t t = 0; t < targetCount; ++t) {
+                Vector2f offset = targets[t] - queries[q];
+                float distanceSq = offset.x * offset.x + offset.y * offset.y;
+                if (distanceSq <= best) {
+                    best = distanceSq;
+                    bruteNearest[q] = static_cast<int32_t>(t);
+                }
+            }
+        }
+    }
+    double bruteSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    const size_t neighbors = EnemyArchetype<ENEMY_SWARMER>::NEIGHBORS;
+    vector<uint32_t> neighborIndices(targetCount * neighbors);
+    vector<uint32_t> neighborCounts(targetCount);
+    start = chrono::steady_clock::now();
+    for (int s = 0; s < steps; ++s) {
+        grid.rebuild(targetCount, [&targets](size_t i) { return targets[i]; });
+        grid.kNearestBatch(targets.data(), targetCount, neighbors, 80, neighborIndices.data(), neighborCounts.data());
+    }
+    double knnSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    auto distanceSq = [&](size_t q, int32_t t) {
+        Vector2f offset = targets[t] - queries[q];
+        return offset.x * offset.x + offset.y * offset.y;
+    };
+    size_t disagreements = 0;
+    for (size_t q = 0; q < queryCount; ++q) {
+        if ((gridNearest[q] < 0) != (bruteNearest[q] < 0) ||
+            (gridNearest[q] >= 0 && distanceSq(q, gridNearest[q]) != distanceSq(q, bruteNearest[q]))) {
+            disagreements++;
+        }
+    }
+
+    cout << targetCount << " targets, " << queryCount << " queries x " << steps << " steps" << endl;
+    cout << "  grid nearest:  " << gridSeconds * 1000 / steps << " ms/step (rebuild included)" << endl;
+    cout << "  brute nearest: " << bruteSeconds * 1000 / steps << " ms/step, " << disagreements << " disagreements" << endl;
+    cout << "  grid " << neighbors << "-nearest for every target: " << knnSeconds * 1000 / steps << " ms/step" << endl;
+}
+
+void runNarrowphaseBenchmark(size_t circleCount, size_t queryCount, int steps) {
+    Random rng(4242);
+    CircleBatch circles;
+    circles.reserve(circleCount);
+    for (size_t i = 0; i < circleCount; ++i) {
+        circles.add(Vector2f(rng.nextInt(WINDOW_WIDTH), rng.nextInt(WINDOW_HEIGHT)), 15.f + rng.nextInt(30));
+    }
+    circles.finish();
+    vector<Vector2f> queries(queryCount);
+    for (auto& query : queries) {
+        query = Vector2f(rng.nextInt(WINDOW_WIDTH), rng.nextInt(WINDOW_HEIGHT));
+    }
+
+    size_t blocks = circles.blockCount();
+    vector<uint32_t> reference(queryCount * blocks);
+    vector<uint32_t> masks(queryCount * blocks);
+    double pairs = static_cast<double>(queryCount) * blocks * CircleBatch::LANES * steps;
+    cout << circleCount << " circles (" << blocks << " blocks of " << CircleBatch::LANES << "), " << queryCount
+        << " bullets x " << steps << " steps, detected " << simdLevelName(detectSimdLevel()) << endl;
+
+    for (int level = SIMD_SCALAR; level <= detectSimdLevel(); ++level) {
+        CircleNarrowphase narrowphase(static_cast<SimdLevel>(level));
+        vector<uint32_t>& out = level == SIMD_SCALAR ? reference : masks;
+        uint64_t hits = 0;
+        auto start = chrono::steady_clock::now();
+        for (int s = 0; s < steps; ++s) {
+            for (size_t q = 0; q < queryCount; ++q) {
+                for (size_t b = 0; b < blocks; ++b) {
+                    uint32_t mask = narrowphase.mask(circles, b, queries[q], 5.f);
+                    out[q * blocks + b] = mask;
+                    hits += mask != 0;
+                }
+            }
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        size_t mismatches = 0;
+        if (level != SIMD_SCALAR) {
+            for (size_t i = 0; i < masks.size(); ++i) {
+                mismatches += masks[i] != reference[i];
+            }
+        }
+        cout << "  " << simdLevelName(static_cast<SimdLevel>(level)) << ": " << pairs / seconds / 1e6
+            << " M pair tests/s, " << hits << " hit blocks, " << mismatches << " mask mismatches" << endl;
+    }
+}
+
+void runRenderBenchmark(size_t systemCount, int frames) {
+    GameWorld world;
+    world.reset(99);
+    for (int i = 0; i < 1200; ++i) {
+        world.step(1.0f / 60, PlayerInput(i % 240 < 120 ? 1.f : -1.f, 0, true));
+        world.clearEffects();
+    }
+
+    systemCount = min(systemCount, RenderFrontEnd::MAX_PARTICLE_JOBS);
+    vector<ParticleSystem> particleSystems(systemCount);
+    vector<const ParticleSystem*> systems;
+    for (size_t i = 0; i < systemCount; ++i) {
+        particleSystems[i].setEmissionRate(100);
+        particleSystems[i].restart(Vector2f(100.f + i * 60, world.getCameraTop() + 300));
+        for (int u = 0; u < 10; ++u) {
+            particleSystems[i].update(1.0f / 60);
+        }
+        systems.push_back(&particleSystems[i]);
+    }
+
+    size_t particles = 0;
+    for (const auto& ps : particleSystems) {
+        particles += ps.getParticleCount();
+    }
+    cout << world.getEnemies().size() << " enemies, " << world.getPlayerBullets().size() + world.getEnemyBullets().size()
+        << " bullets, " << particles << " particles in " << systemCount << " systems, " << frames << " frames" << endl;
+
+    double serialSeconds = 0;
+    for (unsigned threads = 1; threads <= max(1u, thread::hardware_concurrency()); threads *= 2) {
+        RenderFrontEnd frontEnd(threads);
+        frontEnd.setSerialWorkload(0);
+        float layerTotals[RENDER_LAYER_COUNT] = {};
+        auto start = chrono::steady_clock::now();
+        for (int f = 0; f < frames; ++f) {
+            frontEnd.build(world, systems.data(), systems.size());
+            for (int layer = 0; layer < RENDER_LAYER_COUNT; ++layer) {
+                layerTotals[layer] += frontEnd.getLayerSeconds(layer);
+            }
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (threads == 1) {
+            serialSeconds = seconds;
+        }
+
+        cout << "  " << threads << " threads: " << seconds * 1000 / frames << " ms/frame, speedup "
+            << serialSeconds / seconds << "x (";
+        for (int layer = 0; layer < RENDER_LAYER_COUNT; ++layer) {
+            cout << (layer ? ", " : "") << RenderFrontEnd::layerName(layer) << " "
+                << layerTotals[layer] * 1000 / frames << " ms";
+        }
+        cout << ")" << endl;
+    }
+}
+
+EncounterScript benchmarkPatrolScript(ScriptScheduler& scheduler, int index, bool idle, uint64_t& counter) {
+    if (idle) {
+        co_await scheduler.event(SCRIPT_EVENT_WAVE_CLEARED);
+    }
+    double period = 0.25 + (index % 16) * 0.05;
+    while (true) {
+        co_await scheduler.delay(period);
+        counter++;
+        if (index % 4 == 0) {
+            co_await scheduler.event(SCRIPT_EVENT_WAVE_CLEARED);
+            counter++;
+        }
+    }
+}
+
+void runScriptBenchmark(size_t scriptCount, int ticks) {
+    static const char* modes[] = { "no scripts", "suspended", "active" };
+    for (int mode = 0; mode < 3; ++mode) {
+        ScriptScheduler scheduler;
+        uint64_t counter = 0;
+        size_t count = mode == 0 ? 0 : scriptCount;
+        for (size_t i = 0; i < count; ++i) {
+            scheduler.start(benchmarkPatrolScript(scheduler, static_cast<int>(i), mode == 1, counter));
+        }
+
+        auto start = chrono::steady_clock::now();
+        for (int tick = 0; tick < ticks; ++tick) {
+            scheduler.advance(1.0 / 60);
+            if (mode == 2 && tick % 120 == 119) {
+                scheduler.raise(SCRIPT_EVENT_WAVE_CLEARED);
+            }
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << modes[mode] << ": " << count << " scripts x " << ticks << " ticks: " << seconds * 1e9 / ticks << " ns/tick, "
+            << scheduler.getResumeCount() << " resumes (" << (scheduler.getResumeCount() ? seconds * 1e9 /
+            scheduler.getResumeCount() : 0) << " ns each), frames " << scheduler.getFramePool().getLiveBytes()
+            << " bytes live / " << scheduler.getFramePool().getReservedBytes() << " pooled" << endl;
+    }
+}
+
+void runStatusEffectBenchmark(size_t effectCount, int ticks) {
+    const float dt = 1.0f / 60;
+    Random rng(7);
+    StatusEffects effects;
+    vector<float> durations(effectCount);
+    for (size_t i = 0; i < effectCount; ++i) {
+        durations[i] = 1.0f + rng.nextInt(900) / 100.0f;
+        effects.apply(static_cast<StatusEffectType>(i % STATUS_EFFECT_COUNT), durations[i]);
+    }
+
+    uint64_t expired = 0;
+    auto start = chrono::steady_clock::now();
+    for (int tick = 0; tick < ticks; ++tick) {
+        size_t count = effects.advance(dt);
+        expired += count;
+        for (size_t i = 0; i < count; ++i) {
+            effects.apply(static_cast<StatusEffectType>(rng.nextInt(STATUS_EFFECT_COUNT)), 1.0f + rng.nextInt(900) / 100.0f);
+        }
+    }
+    double heapSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<float> remaining(durations);
+    uint64_t scanned = 0;
+    start = chrono::steady_clock::now();
+    for (int tick = 0; tick < ticks; ++tick) {
+        for (auto& time : remaining) {
+            time -= dt;
+            if (time <= 0) {
+                time = 1.0f + rng.nextInt(900) / 100.0f;
+                scanned++;
+            }
+        }
+    }
+    double scanSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << effectCount << " effects x " << ticks << " ticks" << endl;
+    cout << "  expiry heap: " << heapSeconds * 1e9 / ticks << " ns/tick, " << static_cast<double>(expired) / ticks
+        << " expiries/tick, " << effects.getActiveCount() << " active" << endl;
+    cout << "  per-tick scan: " << scanSeconds * 1e9 / ticks << " ns/tick, " << static_cast<double>(scanned) / ticks
+        << " expiries/tick" << endl;
+}
+
+bool sameSnapshot(const SpectatorSnapshot& a, const SpectatorSnapshot& b) {
+    if (!equal(a.globals, a.globals + SPECTATOR_GLOBAL_COUNT, b.globals)) return false;
+    if (a.entities.size() != b.entities.size()) return false;
+    for (size_t i = 0; i < a.entities.size(); ++i) {
+        if (a.entities[i].key != b.entities[i].key ||
+            !equal(a.entities[i].fields, a.entities[i].fields + SPECTATOR_FIELD_COUNT, b.entities[i].fields)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void runBroadcastBenchmark(size_t viewerCount, int ticks, size_t maxDatagram) {
+    SpectatorBroadcaster broadcaster;
+    if (!broadcaster.listen(Socket::AnyPort)) {
+        cout << "Cannot bind a local socket" << endl;
+        return;
+    }
+    broadcaster.setMaxDatagram(maxDatagram);
+
+    vector<unique_ptr<SpectatorClient>> viewers;
+    for (size_t i = 0; i < viewerCount; ++i) {
+        viewers.push_back(make_unique<SpectatorClient>());
+        viewers.back()->connect(IpAddress::LocalHost, broadcaster.getPort());
+        viewers.back()->setAckInterval(i % 4 == 3 ? 8 : 1);
+        viewers.back()->poll(monotonicSeconds());
+    }
+
+    GameWorld world;
+    uint32_t seed = 99;
+    world.reset(seed);
+    SpectatorSnapshot emptySnapshot, full;
+    vector<uint8_t> fullPacket;
+    uint64_t bytes = 0, fullBytes = 0, entities = 0, encodings = 0, inSync = 0, mismatches = 0;
+    double encodeSeconds = 0, sendSeconds = 0, decodeSeconds = 0;
+    for (int tick = 0; tick < ticks; ++tick) {
+        world.step(1.0f / 60, PlayerInput(tick % 240 < 120 ? 1.f : -1.f, 0, true));
+        if (world.isGameOver()) {
+            world.reset(++seed);
+        }
+        broadcaster.broadcast(world, PLAYING);
+        world.clearEffects();
+        bytes += broadcaster.getLastBytes();
+        encodings += broadcaster.getLastEncodings();
+        encodeSeconds += broadcaster.getLastEncodeSeconds();
+        sendSeconds += broadcaster.getLastSendSeconds();
+
+        const SpectatorSnapshot& latest = broadcaster.getLatest();
+        full.sequence = latest.sequence;
+        copy(latest.globals, latest.globals + SPECTATOR_GLOBAL_COUNT, full.globals);
+        full.entities = latest.entities;
+        full.effects = latest.effects;
+        SpectatorCodec::encode(broadcaster.getSession(), emptySnapshot, full, fullPacket);
+        fullBytes += fullPacket.size();
+        entities += latest.entities.size();
+
+        double now = monotonicSeconds();
+        for (auto& viewer : viewers) {
+            viewer->poll(now);
+            viewer->clearEffects();
+            decodeSeconds += viewer->getLastDecodeSeconds();
+            if (!viewer->hasSnapshot() || viewer->getLatest().sequence != latest.sequence) continue;
+            if (sameSnapshot(viewer->getLatest(), latest)) {
+                ++inSync;
+            }
+            else {
+                ++mismatches;
+            }
+        }
+    }
+
+    uint64_t dropped = broadcaster.getDroppedPackets();
+    for (const auto& viewer : viewers) {
+        dropped += viewer->getDroppedPackets();
+    }
+    cout << viewerCount << " viewers x " << ticks << " ticks, " << entities / ticks << " entities/tick" << endl;
+    cout << "  sent " << bytes / ticks << " bytes/tick (" << bytes / ticks / max<size_t>(viewerCount, 1)
+        << " per viewer), full snapshot " << fullBytes / ticks << " bytes" << endl;
+    cout << "  encode " << encodeSeconds * 1e6 / ticks << " us/tick for " << static_cast<double>(encodings) / ticks
+        << " encodings, send " << sendSeconds * 1e6 / ticks << " us/tick, decode " << decodeSeconds * 1e6 / ticks / max<size_t>(viewerCount, 1) << " us/viewer" << endl;
+    cout << "  " << inSync << " viewer ticks in sync, " << mismatches << " mismatches, " << dropped << " dropped packets, "
+        << broadcaster.getFragmentedPackets() << " fragmented, " << broadcaster.getOversizePackets() << " oversize" << endl;
+}
+
+int verifyReplayFile(const string& path) {
+    Replay replay;
+    if (!replay.load(path)) {
+        cout << "Cannot read replay: " << path << endl;
+        return 1;
+    }
+
+    GameWorld world;
+    auto start = chrono::steady_clock::now();
+    ReplayResult result = replay.verify(world);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (result.diverged) {
+        cout << "Replay diverged at tick " << result.tick << ": expected hash " << hex << result.expectedHash
+            << ", actual " << result.actualHash << dec << endl;
+        return 1;
+    }
+    cout << "Replay verified: " << result.tick << " ticks in " << seconds * 1000 << " ms, final hash "
+        << hex << result.actualHash << dec << endl;
+    return 0;
+}
+
+#ifndef SPACE_SHOOTER_NO_MAIN
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "--bench-env") {
+        size_t envCount = argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 1024;
+        int steps = argc > 3 ? atoi(argv[3]) : 1000;
+        runEnvironmentBenchmark(max<size_t>(envCount, 1), steps);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-enemies") {
+        size_t enemyCount = argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 4096;
+        int steps = argc > 3 ? atoi(argv[3]) : 1000;
+        runEnemyBenchmark(max<size_t>(enemyCount, 1), steps);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-spatial") {
+        size_t targetCount = argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 2000;
+        size_t queryCount = argc > 3 ? static_cast<size_t>(atoi(argv[3])) : 4000;
+        runSpatialBenchmark(max<size_t>(targetCount, 1), queryCount, 20);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-narrowphase") {
+        size_t circleCount = argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 256;
+        size_t queryCount = argc > 3 ? static_cast<size_t>(atoi(argv[3])) : 1024;
+        runNarrowphaseBenchmark(max<size_t>(circleCount, 1), queryCount, 50);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-render") {
+        size_t systemCount = argc > 2 ? static_cast<size_t>(atoi(argv[2])) : RenderFrontEnd::MAX_PARTICLE_JOBS;
+        int frames = argc > 3 ? atoi(argv[3]) : 500;
+        runRenderBenchmark(max<size_t>(systemCount, 1), max(frames, 1));
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-scripts") {
+        size_t scriptCount = argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 1000;
+        int ticks = argc > 3 ? atoi(argv[3]) : 36000;
+        runScriptBenchmark(scriptCount, max(ticks, 1));
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-effects") {
+        size_t effectCount = argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 10000;
+        int ticks = argc > 3 ? atoi(argv[3]) : 36000;
+        runStatusEffectBenchmark(effectCount, max(ticks, 1));
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-broadcast") {
+        size_t viewerCount = argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 32;
+        int ticks = argc > 3 ? atoi(argv[3]) : 3600;
+        size_t maxDatagram = argc > 4 ? static_cast<size_t>(atoi(argv[4])) : static_cast<size_t>(UdpSocket::MaxDatagramSize);
+        runBroadcastBenchmark(min(viewerCount, SpectatorBroadcaster::MAX_VIEWERS), max(ticks, 1), maxDatagram);
+        return 0;
+    }
+    if (argc > 2 && string(argv[1]) == "--decode-flight") {
+        return FlightRecorder::decode(argv[2], cout);
+    }
+    if (argc > 2 && string(argv[1]) == "--verify-replay") {
+        return verifyReplayFile(argv[2]);
+    }
+
+    LaunchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "--fps" && i + 1 < argc) {
+            options.targetFrameRate = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else if (option == "--align-refresh" && i + 1 < argc) {
+            options.refreshRate = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else if (option == "--strict-allocations") {
+            options.strictAllocations = true;
+        }
+        else if (option == "--seed" && i + 1 < argc) {
+            options.seed = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else if (option == "--capture" && i + 1 < argc) {
+            options.captureDirectory = argv[++i];
+        }
+        else if (option == "--capture-format" && i + 1 < argc) {
+            options.captureFormat = string(argv[++i]) == "raw" ? CAPTURE_RAW : CAPTURE_PNG;
+        }
+        else if (option == "--capture-lossless") {
+            options.captureLossless = true;
+        }
+        else if (option == "--record" && i + 1 < argc) {
+            options.replayPath = argv[++i];
+        }
+        else if (option == "--flight-seconds" && i + 1 < argc) {
+            options.flightSeconds = max(1.f, static_cast<float>(atof(argv[++i])));
+        }
+        else if (option == "--flight-spike-ms" && i + 1 < argc) {
+            options.flightSpikeMs = static_cast<float>(atof(argv[++i]));
+        }
+        else if (option == "--flight-dir" && i + 1 < argc) {
+            options.flightDirectory = argv[++i];
+        }
+        else if (option == "--broadcast" && i + 1 < argc) {
+            options.broadcastPort = static_cast<unsigned short>(atoi(argv[++i]));
+        }
+        else if (option == "--spectate" && i + 1 < argc) {
+            options.spectatePort = static_cast<unsigned short>(atoi(argv[++i]));
+        }
+    }
+
+    SpaceShooterGame game(options);
     game.run();
     return 0;
 
 }
+#endif